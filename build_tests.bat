@@ -0,0 +1,21 @@
+@echo off
+call "C:\Program Files\Microsoft Visual Studio\2022\Community\VC\Auxiliary\Build\vcvarsall.bat" x64
+
+REM every file in tests is its own unity build, the exit code is the number of failed checks
+SET LIBS=libfftw3f-3.lib
+
+mkdir build
+mkdir bin
+copy deps\fftw\bin\libfftw3f-3.dll bin\
+
+pushd build
+for %%t in (..\tests\*.cpp) do (
+	cl -nologo -O2 -Oi -GR- -EHa- -Zi -FC -diagnostics:column -I ..\deps\fftw\bin /std:c++20 -o ..\bin\test_%%~nt.exe %%t %LIBS% /link /LIBPATH:..\deps\fftw\bin || goto failed
+	..\bin\test_%%~nt.exe || goto failed
+)
+popd
+exit /b 0
+
+:failed
+popd
+exit /b 1
@@ -10,7 +10,7 @@ typedef uint32_t u32;
 typedef  int32_t i32;
 typedef float    f32;
 
-typedef uint32_t u32;
+typedef uint64_t u64;
 typedef  int64_t i64;
 typedef double   f64;
 
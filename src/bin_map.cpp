@@ -0,0 +1,71 @@
+#pragma once
+#include "basetypes.h"
+#include "platform.h"
+#include "fft.cpp"
+
+///////////////////////////////////////////////////////////
+//                   Bin to Pixel Mapping                //
+///////////////////////////////////////////////////////////
+
+//NOTE: which fft bins end up in which display column. This only depends on the width, the displayed frequency range, the fft
+// size and the frequency the fft covers, which changes with decimation and zoom, so it gets rebuilt when one of those changes
+// instead of every frame. Column x covers bins [first_bin[x], last_bin[x]).
+struct BinMap {
+	u32  width;
+	u32  capacity;
+	u32  fft_size;
+	f32  frequency_max_of_fft;
+	f32  frequency_min;
+	f32  frequency_max;
+	f32  bins_per_column;
+	u32* first_bin;
+	u32* last_bin;
+};
+
+global BinMap s_bin_map;
+
+// `frequency_max_of_fft` is the frequency of the last bin (fft_size / 2)
+BinMap& get_bin_map(u32 width, u32 fft_size, f32 frequency_max_of_fft, f32 frequency_min, f32 frequency_max)
+{
+	BinMap& map = s_bin_map;
+	if(map.width == width && map.fft_size == fft_size && map.frequency_max_of_fft == frequency_max_of_fft
+		&& map.frequency_min == frequency_min && map.frequency_max == frequency_max) {
+		return map;
+	}
+
+	if(map.capacity < width) {
+		replace_memory((void**)&map.first_bin, width * sizeof(u32));
+		replace_memory((void**)&map.last_bin, width * sizeof(u32));
+		map.capacity = width;
+	}
+	map.width         = width;
+	map.fft_size      = fft_size;
+	map.frequency_max_of_fft = frequency_max_of_fft;
+	map.frequency_min = frequency_min;
+	map.frequency_max = frequency_max;
+
+	u32 buckets = fft_size / 2;
+	f32 scale   = (frequency_max - frequency_min) / frequency_max_of_fft;
+	f32 offset  = frequency_min / frequency_max_of_fft;
+	map.bins_per_column = (f32)buckets / width * scale;
+	for(u32 i = 0; i < width; i++) {
+		u32 first_bin = buckets * offset + map.bins_per_column * i;
+		u32 last_bin  = buckets * offset + map.bins_per_column * (i + 1);
+		if(last_bin == first_bin) last_bin = first_bin + 1;
+		map.first_bin[i] = min(first_bin, buckets);
+		map.last_bin[i]  = min(last_bin, buckets + 1);
+	}
+	return map;
+}
+
+// prefix[i] is the sum of the values of bins [0, i), so the sum over any bin range is one subtraction.
+// f64 because column sums are small differences of large totals.
+void compute_prefix_sums(const f32* values, u32 bin_count, f64* prefix)
+{
+	f64 sum = 0;
+	prefix[0] = 0;
+	for(u32 i = 0; i < bin_count; i++) {
+		sum += values[i];
+		prefix[i + 1] = sum;
+	}
+}
@@ -0,0 +1,241 @@
+#pragma once
+#include <atomic>
+#include <math.h>
+#include "basetypes.h"
+#include "platform.h"
+#include "stft.cpp"
+#include "fft.cpp"
+
+///////////////////////////////////////////////////////////
+//                  Constant-Q Transform                 //
+///////////////////////////////////////////////////////////
+
+//NOTE: constant-Q bins are computed from the fft output with sparse spectral kernels (Brown & Puckette). Bin k sits at
+// frequency_min * 2^(k / CQT_BINS_PER_OCTAVE) and correlates the frame with a hann windowed complex sinusoid that is Q periods
+// long, centered in the frame. By Parseval that correlation is a dot product of the fft output with the kernel's spectrum,
+// which is only significant in a few bins around the bin frequency, so only those get stored.
+// Kernels depend on the fft size, the range and the stft window. Building them for a large fft takes long enough to hitch the
+// ui on every range change, so they are built on their own thread into the set nothing reads and swapped in between rounds
+// once done. Changes that come in while a build runs are picked up by one build after it. Until then the kernels in use were
+// built for another size or window and rounds publish no constant-Q bins, see cqt_kernels_fit.
+global const u32 CQT_BINS_PER_OCTAVE  = 24;
+global const f32 CQT_MIN_FREQUENCY    = 20.0f;
+global const f64 CQT_KERNEL_THRESHOLD = 0.0054; // relative to the kernel's peak, drops everything past the second side lobe
+global const f64 CQT_KERNEL_SPAN      = 5.0;    // bins searched on each side in multiples of fft_size / kernel_length, the threshold cuts off before that
+
+struct CqtKernels {
+	u32  fft_size;
+	u32  sample_rate;
+	f32  range_min; // requested range, the actual one can be narrower
+	f32  range_max;
+	f32* window;    // the stft window it was requested for, the build reads s_cqt_build_window
+	u32  window_generation; // s_cqt_window_generation when requested
+
+	f32  frequency_min; // frequency of bin 0
+	u32  bin_count;
+	u32  first_bin[MAX_CQT_BINS];      // first fft bin the kernel covers
+	u32  weight_count[MAX_CQT_BINS];
+	u32  weight_offset[MAX_CQT_BINS]; // in complex weights
+	f32* weights;                      // interleaved re / im
+	u32  weight_capacity;
+};
+
+global CqtKernels        s_cqt_kernel_sets[2];
+global CqtKernels*       s_cqt_kernels  = s_cqt_kernel_sets;     // used by rounds and the renderer
+global CqtKernels*       s_cqt_building = s_cqt_kernel_sets + 1; // only touched by the build thread while a build runs
+global f32*              s_cqt_build_window;  // copy of the requested stft window, the live one can be rebuilt during a build
+global void*             s_cqt_build_semaphore;
+global std::atomic<bool> s_cqt_build_running;
+global bool              s_cqt_build_pending; // ui thread, handed out and not swapped in yet
+global u32               s_cqt_window_generation; // ui thread, bumped when the stft windows get rebuilt in place
+
+f64 cqt_q()
+{
+	return 1.0 / (pow(2.0, 1.0 / CQT_BINS_PER_OCTAVE) - 1.0);
+}
+
+f32 cqt_bin_frequency(CqtKernels* kernels, f32 bin)
+{
+	return kernels->frequency_min * powf(2.0f, bin / CQT_BINS_PER_OCTAVE);
+}
+
+// sum of e^(i theta n) for n in [0, length)
+void dirichlet_sum(f64 theta, f64 length, f64* re, f64* im)
+{
+	f64 s = sin(theta / 2);
+	f64 magnitude = fabs(s) < 1e-12 ? length : sin(length * theta / 2) / s;
+	f64 phase = theta * (length - 1) / 2;
+	*re = magnitude * cos(phase);
+	*im = magnitude * sin(phase);
+}
+
+//NOTE: spectrum of a hann windowed complex sinusoid of `length` samples at `theta` from its frequency, normalized by the length.
+// The window is 0.5 - 0.25 e^(i 2pi n / L) - 0.25 e^(-i 2pi n / L), so the spectrum is three shifted dirichlet kernels.
+void hann_kernel_spectrum(f64 theta, f64 length, f64* re, f64* im)
+{
+	f64 re0, im0, re1, im1, re2, im2;
+	dirichlet_sum(theta,                   length, &re0, &im0);
+	dirichlet_sum(theta + 2 * PI / length, length, &re1, &im1);
+	dirichlet_sum(theta - 2 * PI / length, length, &re2, &im2);
+	*re = (0.5 * re0 - 0.25 * re1 - 0.25 * re2) / length;
+	*im = (0.5 * im0 - 0.25 * im1 - 0.25 * im2) / length;
+}
+
+// forces a rebuild on the next update, e.g. after the stft window changed
+void invalidate_cqt_kernels()
+{
+	s_cqt_window_generation++;
+}
+
+// whether `kernels` can be applied to frames of this size, window and rate
+bool cqt_kernels_fit(CqtKernels* kernels, u32 fft_size, const f32* window, u32 sample_rate)
+{
+	return kernels->bin_count && kernels->fft_size == fft_size && kernels->window == window && kernels->sample_rate == sample_rate
+		&& kernels->window_generation == s_cqt_window_generation;
+}
+
+// build thread, fills in everything past the requested parameters
+void build_cqt_kernels(CqtKernels* request, const f32* window)
+{
+	CqtKernels& kernels = *request;
+	u32 fft_size    = kernels.fft_size;
+	u32 sample_rate = kernels.sample_rate;
+	f32 range_min   = kernels.range_min;
+	f32 range_max   = kernels.range_max;
+
+	// the longest kernel has to fit into the frame
+	f64 q = cqt_q();
+	f64 frequency_min = max((f64)max(range_min, CQT_MIN_FREQUENCY), q * sample_rate / fft_size);
+	kernels.frequency_min = (f32)frequency_min;
+	kernels.bin_count = 0;
+	if(range_max <= frequency_min) return;
+	kernels.bin_count = min((u32)(CQT_BINS_PER_OCTAVE * log2(range_max / frequency_min)) + 1, MAX_CQT_BINS);
+
+	u32 last_fft_bin = fft_size / 2;
+	u32 capacity = 0;
+	for(u32 k = 0; k < kernels.bin_count; k++) {
+		f64 length = round(q * sample_rate / cqt_bin_frequency(&kernels, k));
+		capacity += 2 * (u32)ceil(CQT_KERNEL_SPAN * fft_size / length) + 1;
+	}
+	if(kernels.weight_capacity < capacity) {
+		replace_memory((void**)&kernels.weights, capacity * 2 * sizeof(f32));
+		kernels.weight_capacity = capacity;
+	}
+
+	u32 offset = 0;
+	for(u32 k = 0; k < kernels.bin_count; k++) {
+		f64 frequency = cqt_bin_frequency(&kernels, k);
+		f64 length    = round(q * sample_rate / frequency);
+		f64 omega     = 2 * PI * frequency / sample_rate;
+		u32 start     = (fft_size - (u32)length) / 2;
+
+		// the frame already went through the stft window, scale the kernel back up by how much that attenuated it
+		f64 windowed = 0;
+		for(u32 n = 0; n < (u32)length; n++) {
+			windowed += window[start + n] * (0.5 - 0.5 * cos(2 * PI * n / length));
+		}
+		f64 window_gain = windowed / (length / 2);
+		// a sine of amplitude A correlates to A / 4 with the kernel, results are scaled to A / 2 like the linear spectrum
+		f64 scale = 2.0 / (fft_size * window_gain);
+
+		f64 center = frequency * fft_size / sample_rate;
+		f64 span   = ceil(CQT_KERNEL_SPAN * fft_size / length);
+		u32 first  = (u32)max(center - span, 0.0);
+		u32 last   = (u32)min(center + span, (f64)last_fft_bin);
+
+		// only bins above the threshold are significant, the kernel starting at `start` adds a linear phase to them
+		kernels.first_bin[k]     = first;
+		kernels.weight_offset[k] = offset;
+		u32 kept_first = last + 1;
+		u32 kept_last  = first;
+		for(u32 j = first; j <= last; j++) {
+			f64 theta = omega - 2 * PI * j / fft_size;
+			f64 re, im;
+			hann_kernel_spectrum(theta, length, &re, &im);
+			if(sqrt(re * re + im * im) < CQT_KERNEL_THRESHOLD * 0.5) continue;
+			kept_first = min(kept_first, j);
+			kept_last  = j;
+		}
+		if(kept_first > kept_last) {
+			kernels.weight_count[k] = 0;
+			continue;
+		}
+
+		// everything between the outermost significant bins gets stored so applying a kernel is one contiguous dot product
+		kernels.first_bin[k]    = kept_first;
+		kernels.weight_count[k] = kept_last - kept_first + 1;
+		for(u32 j = kept_first; j <= kept_last; j++) {
+			f64 theta = omega - 2 * PI * j / fft_size;
+			f64 re, im;
+			hann_kernel_spectrum(theta, length, &re, &im);
+			f64 shift_re = cos(theta * start);
+			f64 shift_im = sin(theta * start);
+			f64 kernel_re = re * shift_re - im * shift_im;
+			f64 kernel_im = re * shift_im + im * shift_re;
+			// stored conjugated, applying the kernel is then a plain complex multiply and add
+			kernels.weights[offset * 2 + 0] = (f32)( kernel_re * scale);
+			kernels.weights[offset * 2 + 1] = (f32)(-kernel_im * scale);
+			offset++;
+		}
+	}
+}
+
+void cqt_build_thread(void* data)
+{
+	for(;;) {
+		wait_semaphore(s_cqt_build_semaphore);
+		build_cqt_kernels(s_cqt_building, s_cqt_build_window);
+		s_cqt_build_running.store(false, std::memory_order_release);
+	}
+}
+
+void start_cqt_build_thread()
+{
+	s_cqt_build_window    = (f32*)r_allocate(MAX_FFT_SIZE * sizeof(f32));
+	s_cqt_build_semaphore = create_semaphore();
+	start_thread(cqt_build_thread, 0);
+}
+
+//NOTE: ui thread, between rounds. Swaps in a finished build, then hands out a new one if the kernels in use don't match the
+// request. Until a build is swapped in rounds keep the previous kernels, as long as they still fit the frames.
+void update_cqt_kernels(u32 fft_size, const f32* window, u32 sample_rate, f32 range_min, f32 range_max)
+{
+	if(s_cqt_build_pending) {
+		if(s_cqt_build_running.load(std::memory_order_acquire)) return;
+		CqtKernels* built = s_cqt_building;
+		s_cqt_building = s_cqt_kernels;
+		s_cqt_kernels  = built;
+		s_cqt_build_pending = false;
+	}
+
+	CqtKernels& kernels = *s_cqt_kernels;
+	if(kernels.window_generation == s_cqt_window_generation && kernels.fft_size == fft_size && kernels.window == window
+		&& kernels.sample_rate == sample_rate && kernels.range_min == range_min && kernels.range_max == range_max) return;
+
+	CqtKernels& request = *s_cqt_building;
+	request.fft_size    = fft_size;
+	request.sample_rate = sample_rate;
+	request.window      = (f32*)window;
+	request.range_min   = range_min;
+	request.range_max   = range_max;
+	request.window_generation = s_cqt_window_generation;
+	memcpy(s_cqt_build_window, window, fft_size * sizeof(f32));
+	s_cqt_build_pending = true;
+	s_cqt_build_running.store(true, std::memory_order_relaxed);
+	signal_semaphore(s_cqt_build_semaphore, 1);
+}
+
+// constant-Q magnitudes of one frame, `magnitudes` gets kernels->bin_count entries
+void apply_cqt_kernels(CqtKernels* kernels, const fftwf_complex* bins, f32* magnitudes)
+{
+	for(u32 k = 0; k < kernels->bin_count; k++) {
+		const f32* x = (const f32*)(bins + kernels->first_bin[k]);
+		const f32* w = kernels->weights + kernels->weight_offset[k] * 2;
+		f32 re = 0, im = 0;
+		for(u32 j = 0; j < kernels->weight_count[k]; j++) {
+			re += x[j * 2] * w[j * 2]     - x[j * 2 + 1] * w[j * 2 + 1];
+			im += x[j * 2] * w[j * 2 + 1] + x[j * 2 + 1] * w[j * 2];
+		}
+		magnitudes[k] = sqrtf(re * re + im * im);
+	}
+}
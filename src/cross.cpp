@@ -0,0 +1,115 @@
+#pragma once
+#include <math.h>
+#include "basetypes.h"
+#include "platform.h"
+#include "fft.cpp"
+
+///////////////////////////////////////////////////////////
+//                  Dual Channel Analysis                //
+///////////////////////////////////////////////////////////
+
+//NOTE: every device measured against one reference device from the spectra the rounds compute anyway. Per frame and bin that is
+// the reference's power Gxx, the device's power Gyy and the cross spectrum Gxy = conj(X) Y, averaged like the exponential psd:
+// a cumulative mean for the first CROSS_AVERAGE_FRAMES frames, exponential with that time constant after. From those follow
+//  transfer function - H1 = Gxy / Gxx, magnitude and phase of the device relative to the reference
+//  coherence         - |Gxy|^2 / (Gxx Gyy), 1 where the device is a linear function of the reference, 0 for unrelated signals
+// A pair needs both devices' bins of the same frame, which only the batched job has at once, so cross analysis keeps rounds
+// batched whenever every device is due. Frames are paired by the sample count they end at (see pair_frames), rounds that
+// can't be batched keep showing the averages as they are. Devices whose captures are offset by a good part of the fft size
+// lose coherence (see delay.cpp).
+global const u32 CROSS_AVERAGE_FRAMES = 32;
+global const f32 CROSS_DISPLAY_DB     = 40.0f; // the transfer magnitude is drawn from -this to +this dB
+
+struct CrossSpectrum {
+	f32*           power; // Gyy, for the reference device its Gxx
+	fftwf_complex* cross; // Gxy, unused on the reference device
+};
+
+struct CrossAverage {
+	u32 key;       // psd_key of the bins, see psd.cpp
+	u32 reference;
+	u32 bin_count;
+	u32 frames;    // up to CROSS_AVERAGE_FRAMES
+};
+
+// what a column of the display shows, computed from the averages of its bins
+struct CrossColumn {
+	f32 magnitude; // dB
+	f32 phase;     // -pi .. pi
+	f32 coherence;
+};
+
+global bool         s_cross_analysis;
+global u32          s_cross_reference;
+global CrossAverage s_cross_average;
+
+void allocate_cross_spectrum(CrossSpectrum* spectrum)
+{
+	spectrum->power = (f32*)r_allocate((MAX_FFT_SIZE / 2 + 1) * sizeof(f32));
+	spectrum->cross = fftwf_alloc_complex(MAX_FFT_SIZE / 2 + 1);
+}
+
+// feeds the frame the batch buffers currently hold, `key` and `reference` changing starts over
+void accumulate_cross_spectra(CrossAverage* average, CrossSpectrum* spectra, u32 device_count, u32 reference, u32 fft_size, u32 key)
+{
+	u32 bin_count = fft_size / 2 + 1;
+	if(average->key != key || average->reference != reference || average->bin_count != bin_count) {
+		average->key       = key;
+		average->reference = reference;
+		average->bin_count = bin_count;
+		average->frames    = 0;
+	}
+	average->frames = min(average->frames + 1, CROSS_AVERAGE_FRAMES);
+	f32 alpha = 1.0f / average->frames;
+
+	const fftwf_complex* x = fft_output(reference, fft_size);
+	for(u32 d = 0; d < device_count; d++) {
+		const fftwf_complex* y = fft_output(d, fft_size);
+		CrossSpectrum& spectrum = spectra[d];
+		for(u32 k = 0; k < bin_count; k++) {
+			f32 power = y[k][0] * y[k][0] + y[k][1] * y[k][1];
+			spectrum.power[k] += alpha * (power - spectrum.power[k]);
+		}
+		if(d == reference) continue;
+
+		for(u32 k = 0; k < bin_count; k++) {
+			f32 re = x[k][0] * y[k][0] + x[k][1] * y[k][1];
+			f32 im = x[k][0] * y[k][1] - x[k][1] * y[k][0];
+			spectrum.cross[k][0] += alpha * (re - spectrum.cross[k][0]);
+			spectrum.cross[k][1] += alpha * (im - spectrum.cross[k][1]);
+		}
+	}
+}
+
+void publish_cross(CrossAverage* average, CrossSpectrum* spectra, u32 d, SpectrumSlot& slot)
+{
+	slot.cross_valid = average->frames > 0 && d != average->reference;
+	if(!slot.cross_valid) return;
+
+	u32 bin_count = average->bin_count;
+	slot.cross_reference = average->reference;
+	slot.cross_frames    = average->frames;
+	memcpy(slot.cross_reference_power, spectra[average->reference].power, bin_count * sizeof(f32));
+	memcpy(slot.cross_power, spectra[d].power, bin_count * sizeof(f32));
+	memcpy(slot.cross, spectra[d].cross, bin_count * sizeof(fftwf_complex));
+}
+
+// bins [first_bin, last_bin) summed before dividing, so a wide column shows the band's transfer function and coherence
+CrossColumn cross_column(SpectrumSlot& slot, u32 first_bin, u32 last_bin)
+{
+	f64 gxx = 0, gyy = 0, re = 0, im = 0;
+	for(u32 k = first_bin; k < last_bin; k++) {
+		gxx += slot.cross_reference_power[k];
+		gyy += slot.cross_power[k];
+		re  += slot.cross[k][0];
+		im  += slot.cross[k][1];
+	}
+
+	CrossColumn column = {};
+	f64 cross_power = re * re + im * im;
+	if(gxx > 0) column.magnitude = (f32)(10 * log10(max(cross_power, 1e-30) / (gxx * gxx)));
+	else        column.magnitude = -CROSS_DISPLAY_DB;
+	column.phase = (f32)atan2(im, re);
+	if(gxx > 0 && gyy > 0) column.coherence = (f32)min(cross_power / (gxx * gyy), 1.0);
+	return column;
+}
@@ -0,0 +1,146 @@
+#pragma once
+#include <math.h>
+#include "basetypes.h"
+#include "platform.h"
+#include "stft.cpp"
+#include "simd.cpp"
+#include "sample_ring.cpp"
+
+///////////////////////////////////////////////////////////
+//                  Half-band Decimation                 //
+///////////////////////////////////////////////////////////
+
+//NOTE: cascade of half-band low pass filters that each halve the sample rate. With the displayed range in the lower part of the
+// spectrum the fft runs on the decimated stream instead, a transform decimation times smaller then gives the same resolution.
+// Half-band filters have every other tap zero, so each stage splits its input into even and odd samples: an output is the dot
+// product of the last HALFBAND_TAPS even samples with the nonzero taps plus half of the odd sample in the middle (polyphase).
+// The cascade runs on the sample stream and keeps its history per device, every sample goes through it once.
+global const u32 MAX_HALFBAND_STAGES     = 5;
+global const u32 HALFBAND_TAPS           = 32;  // nonzero taps besides the center one, the filter is 2 * HALFBAND_TAPS - 1 long
+global const u32 HALFBAND_HISTORY        = 64;  // power of two >= HALFBAND_TAPS
+global const f32 HALFBAND_PASSBAND       = 0.8f; // usable fraction of the decimated nyquist frequency
+global const f64 HALFBAND_KAISER_BETA    = 8.0;
+global const u32 DECIMATED_RING_CAPACITY = 65536; // power of two, holds a full frame plus a round of hops at any decimation
+
+struct HalfbandStage {
+	u64 count;                        // input samples seen
+	f32 even[HALFBAND_HISTORY * 2];   // every sample is stored twice so the newest HALFBAND_TAPS are contiguous
+	f32 odd[HALFBAND_HISTORY];
+};
+
+struct DecimatorState {
+	u32           stage_count;
+	u64           position; // next input sample
+	HalfbandStage stages[MAX_HALFBAND_STAGES];
+	f32*          output;   // ring of decimated samples, indexed by position >> stage_count
+	u64           output_count;
+};
+
+global f32 s_halfband_taps[HALFBAND_TAPS];
+
+//NOTE: kaiser windowed sinc with its cutoff at a quarter of the input rate. Tap i sits at offset 2 * i - (HALFBAND_TAPS - 1)
+// from the center, all of them odd, the even offsets besides the center are zero.
+void init_halfband_taps()
+{
+	f64 half_length = HALFBAND_TAPS - 1;
+	f64 sum = 0;
+	for(u32 i = 0; i < HALFBAND_TAPS; i++) {
+		f64 offset = 2.0 * i - half_length;
+		f64 r = offset / half_length;
+		f64 window = bessel_i0(HALFBAND_KAISER_BETA * sqrt(1 - r * r)) / bessel_i0(HALFBAND_KAISER_BETA);
+		s_halfband_taps[i] = sin(PI * offset / 2) / (PI * offset) * window;
+		sum += s_halfband_taps[i];
+	}
+	// unity gain at dc together with the center tap of 0.5
+	for(u32 i = 0; i < HALFBAND_TAPS; i++) s_halfband_taps[i] *= 0.5 / sum;
+}
+
+void allocate_decimator(DecimatorState* state)
+{
+	state->output = (f32*)r_allocate(DECIMATED_RING_CAPACITY * sizeof(f32));
+}
+
+// number of halvings that still keeps `frequency_max` in the passband, limited so the transform doesn't drop below `min_fft_size`
+u32 select_decimation_stages(u32 sample_rate, f32 frequency_max, u32 fft_size, u32 min_fft_size)
+{
+	u32 stages = 0;
+	while(stages < MAX_HALFBAND_STAGES && (fft_size >> (stages + 1)) >= min_fft_size
+		&& frequency_max <= HALFBAND_PASSBAND * sample_rate / (2 << (stages + 1))) {
+		stages++;
+	}
+	return stages;
+}
+
+// starts at `position`, which has to be a multiple of 2^MAX_HALFBAND_STAGES so outputs line up with absolute positions
+void reset_decimator(DecimatorState* state, u32 stage_count, u64 position)
+{
+	state->stage_count  = stage_count;
+	state->position     = position;
+	state->output_count = position >> stage_count;
+	for(u32 s = 0; s < MAX_HALFBAND_STAGES; s++) {
+		memset(&state->stages[s], 0, sizeof(HalfbandStage));
+	}
+}
+
+// returns true and writes `output` for every even input
+bool halfband_push(HalfbandStage* stage, f32 input, f32* output)
+{
+	u64 index = stage->count++;
+	u32 half  = (u32)(index >> 1);
+	if(index & 1) {
+		stage->odd[half & (HALFBAND_HISTORY - 1)] = input;
+		return false;
+	}
+
+	u32 slot = half & (HALFBAND_HISTORY - 1);
+	stage->even[slot] = stage->even[slot + HALFBAND_HISTORY] = input;
+
+	// the center tap sits HALFBAND_TAPS - 1 samples back, which is the odd sample HALFBAND_TAPS / 2 pairs ago
+	const f32* even = stage->even + slot + HALFBAND_HISTORY + 1 - HALFBAND_TAPS;
+	f32 center = stage->odd[(half - HALFBAND_TAPS / 2) & (HALFBAND_HISTORY - 1)];
+	*output = dot_product_f32(even, s_halfband_taps, HALFBAND_TAPS) + 0.5f * center;
+	return true;
+}
+
+void decimate_samples(DecimatorState* state, const i16* samples, u32 count)
+{
+	for(u32 i = 0; i < count; i++) {
+		f32 value = samples[i];
+		u32 s = 0;
+		for(; s < state->stage_count; s++) {
+			if(!halfband_push(&state->stages[s], value, &value)) break;
+		}
+		if(s == state->stage_count) state->output[state->output_count++ & (DECIMATED_RING_CAPACITY - 1)] = value;
+	}
+	state->position += count;
+}
+
+//NOTE: brings the decimator up to `end`. A decimator that is configured differently or fell behind what the ring still holds
+// starts over at `restart`, or the oldest sample the ring still holds if that is later. The start gets aligned down so the
+// filters see everything from `restart` on, only when the ring no longer holds that far back it goes up to the next alignment.
+void decimate_until(DecimatorState* state, SampleRing* ring, u32 stage_count, u64 end, u64 restart)
+{
+	u64 read_count = ring->read_count.load(std::memory_order_relaxed);
+	bool stale = state->position < read_count || state->position > end;
+	if(state->stage_count != stage_count || stale) {
+		u64 alignment = 1 << MAX_HALFBAND_STAGES;
+		u64 start = max(restart, read_count) & ~(alignment - 1);
+		if(start < read_count) start += alignment;
+		reset_decimator(state, stage_count, start);
+	}
+	if(state->position >= end) return;
+
+	RingSpan span = ring_span(ring, state->position, (u32)(end - state->position));
+	decimate_samples(state, span.first, span.first_length);
+	decimate_samples(state, span.second, span.second_length);
+}
+
+// `count` decimated samples that end at input position `end`, multiplied by `window`
+void gather_decimated(DecimatorState* state, u64 end, const f32* window, f32* dst, u32 count)
+{
+	u32 mask  = DECIMATED_RING_CAPACITY - 1;
+	u32 start = (u32)(((end >> state->stage_count) - count) & mask);
+	u32 first = min(count, DECIMATED_RING_CAPACITY - start);
+	multiply_f32(state->output + start, window, dst, first);
+	multiply_f32(state->output, window + first, dst + first, count - first);
+}
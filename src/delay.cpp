@@ -0,0 +1,90 @@
+#pragma once
+#include <math.h>
+#include "basetypes.h"
+#include "platform.h"
+#include "fft.cpp"
+#include "cross.cpp"
+
+///////////////////////////////////////////////////////////
+//                    Delay Estimation                   //
+///////////////////////////////////////////////////////////
+
+//NOTE: how much later than the reference every device picks up the same signal, by generalized cross correlation with the
+// phase transform (gcc-phat) of the averaged cross spectra of cross.cpp. Every bin of Gxy gets scaled to unit magnitude so
+// all frequencies weigh the same, its inverse transform then is a peak at the lag between the two devices. The peak gets
+// refined from the slope of the cross spectrum's phase once the lag is taken out, a parabola through the peak's neighbours is
+// off by up to a tenth of a sample on the sinc shaped peak. Its height relative to a perfect match is the confidence.
+// The inverse plans are created at startup for every fft size on the first device's buffers and shared by everyone, so a
+// round costs one inverse transform of the round's size per device. Lags up to half the fft size can be told apart, positive
+// ones mean the device lags the reference.
+struct DelayState {
+	fftwf_complex* whitened;
+	f32*           correlation;
+};
+
+global bool       s_delay_estimation;
+global fftwf_plan s_delay_plans[FFT_SIZE_COUNT];
+
+void create_delay_plans(DelayState* states, u32 device_count)
+{
+	for(u32 d = 0; d < device_count; d++) {
+		states[d].whitened    = fftwf_alloc_complex(MAX_FFT_SIZE / 2 + 1);
+		states[d].correlation = fftwf_alloc_real(MAX_FFT_SIZE);
+	}
+	if(device_count < 2) return;
+
+	f64 start = get_seconds();
+	for(u32 i = 0; i < FFT_SIZE_COUNT; i++) {
+		s_delay_plans[i] = fftwf_plan_dft_c2r_1d(s_fft_sizes[i], states[0].whitened, states[0].correlation, s_plan_quality_flags[s_plan_quality]);
+		s_plan_report.plans_created++;
+	}
+	s_plan_report.planning_seconds += get_seconds() - start;
+}
+
+//NOTE: reads the cross spectrum the slot was just published with, its size and decimation are the round's.
+// Delays are in samples of the full rate stream.
+void estimate_delay(DelayState* state, SpectrumSlot& slot, u32 size_index, u32 decimation)
+{
+	u32 size = s_fft_sizes[size_index];
+	u32 bin_count = size / 2 + 1;
+	fftwf_complex* whitened = state->whitened;
+
+	// dc and nyquist carry no phase, leaving them out keeps the window's dc from dominating
+	whitened[0][0] = whitened[0][1] = 0;
+	whitened[bin_count - 1][0] = whitened[bin_count - 1][1] = 0;
+	for(u32 k = 1; k + 1 < bin_count; k++) {
+		f32 re = slot.cross[k][0];
+		f32 im = slot.cross[k][1];
+		f32 magnitude = sqrtf(re * re + im * im);
+		f32 scale = magnitude > 0 ? 1 / magnitude : 0;
+		whitened[k][0] = re * scale;
+		whitened[k][1] = im * scale;
+	}
+	fftwf_execute_dft_c2r(s_delay_plans[size_index], whitened, state->correlation);
+
+	const f32* correlation = state->correlation;
+	u32 best = 0;
+	for(u32 i = 1; i < size; i++) if(correlation[i] > correlation[best]) best = i;
+
+	f32 lag = best < size / 2 ? (f32)best : (f32)best - size;
+
+	// what is left of the phase after removing the integer lag is -omega * offset, fit through the origin weighted by |Gxy|
+	// so bins without a shared signal barely count. The residual stays within +-pi / 2 for offsets up to half a sample.
+	f64 numerator = 0, denominator = 0;
+	for(u32 k = 1; k + 1 < bin_count; k++) {
+		f64 omega = 2 * PI * k / size;
+		f64 re = slot.cross[k][0];
+		f64 im = slot.cross[k][1];
+		f64 shift_re = cos(omega * lag), shift_im = sin(omega * lag);
+		f64 phase  = atan2(im * shift_re + re * shift_im, re * shift_re - im * shift_im);
+		f64 weight = sqrt(re * re + im * im);
+		numerator   -= weight * omega * phase;
+		denominator += weight * omega * omega;
+	}
+	f32 offset = denominator > 0 ? (f32)max(min(numerator / denominator, 0.5), -0.5) : 0;
+
+	// every bin but dc and nyquist shows up twice in the full spectrum, a perfect match sums to that many
+	slot.delay_valid      = true;
+	slot.delay            = (lag + offset) * decimation;
+	slot.delay_confidence = max(min(correlation[best] / (size - 2), 1.0f), 0.0f);
+}
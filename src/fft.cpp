@@ -0,0 +1,265 @@
+#pragma once
+#include "basetypes.h"
+#include "platform.h"
+#include "stft.cpp"
+
+#undef global
+
+#include <string.h>
+#include <complex.h>
+#include <fftw3.h>
+
+#define global static
+
+///////////////////////////////////////////////////////////
+//                      FFT Engine                       //
+///////////////////////////////////////////////////////////
+
+global const u32 s_fft_sizes[]  = { 1024, 2048, 4096, 8192, 16384, 32768, 65536 };
+global const u32 FFT_SIZE_COUNT = sizeof(s_fft_sizes) / sizeof(s_fft_sizes[0]);
+global const u32 MAX_FFT_SIZE   = 65536;
+global const u32 MAX_CQT_BINS   = 256; // see cqt.cpp
+global const u32 MAX_ZOOM_BINS  = 4096; // see zoom.cpp
+global const u32 MAX_PEAKS      = 16; // see peaks.cpp
+global const u32 MAX_BANDS      = 128; // see octave.cpp
+
+//NOTE: single precision real input (r2c) transforms of all devices share one contiguous strided buffer pair so they can be
+// transformed with a single plan_many call. For the active size n device d's samples start at in + d * n and its half spectrum
+// of n / 2 + 1 bins at out + d * fft_bin_stride(n). The buffers are sized for the largest transform, so every cached plan can run
+// on them without reallocating when the size changes.
+struct FFTBatch {
+	u32            device_count;
+	f32*           in;
+	fftwf_complex* out;
+};
+
+// one plan and window per selectable size, all of them get created at startup so switching sizes is just an index change
+struct FFTPlan {
+	u32        size;
+	fftwf_plan plan;       // single device, run on a device's slice with fftwf_execute_dft_r2c
+	fftwf_plan batch_plan; // all devices at once
+	f32*       window;
+	f64        window_sum;
+	f64        window_power;
+};
+
+//NOTE: published results of one device. Workers only ever write the back slot (front ^ 1), the ui thread flips `front` once the
+// jobs that wrote it are finished, so the renderer reads the front slot without taking any locks.
+enum SpectrumScale : u32 {
+	SPECTRUM_SCALE_LINEAR,
+	SPECTRUM_SCALE_DECIBEL,
+
+	SPECTRUM_SCALE_COUNT,
+};
+
+global const char* s_spectrum_scale_names[SPECTRUM_SCALE_COUNT] = { "linear", "dB" };
+
+enum FrequencyAxis : u32 {
+	FREQUENCY_AXIS_LINEAR,
+	FREQUENCY_AXIS_CONSTANT_Q, // logarithmic, see cqt.cpp
+
+	FREQUENCY_AXIS_COUNT,
+};
+
+global const char* s_frequency_axis_names[FREQUENCY_AXIS_COUNT] = { "linear", "constant-Q" };
+
+struct Peak {
+	f32 frequency;
+	f32 level; // amplitude / 2 like the linear spectrum
+	u32 track; // stable while the peak gets tracked from frame to frame, 0 if it couldn't be
+	u32 age;   // frames the track has lived
+};
+
+struct PitchEstimate {
+	f32 frequency;  // 0 if there was nothing to estimate
+	f32 confidence; // 0 .. 1
+	u64 frame_end;
+};
+
+struct SpectrumSlot {
+	fftwf_complex* bins;
+	f32*           magnitudes; // |bins|, written for every frame of a round so per frame stages can read it
+	f32*           decibels;   // magnitudes in dBFS, only written for the published frame in decibel scale
+	f64*           prefix;     // bins + 1 entries of the values in `scale`, see compute_prefix_sums
+	SpectrumScale  scale;
+	FrequencyAxis  axis;
+	f32*           cqt;        // constant-Q bins in `scale`, only written in constant-Q axis
+	u32            cqt_bin_count;
+	bool           zoomed;
+	f32*           zoom;       // zoom fft bins in `scale`, lowest frequency first, only written when zoomed
+	f32            zoom_frequency_min;
+	f32            zoom_bin_width;
+	u32            size_index; // fft size the bins were computed with
+	u32            decimation; // the bins were computed at the sample rate divided by this
+	u64            frame_end;  // sample count the frame ended at
+	bool           averaged;     // magnitudes and prefix hold the averaged spectrum, see psd.cpp
+	f32*           psd;          // averaged power spectral density in full scale^2 / Hz, only written when averaged
+	bool           noise_valid;
+	f32*           noise_floor;  // per bin noise floor in the units of psd
+	f64*           noise_prefix; // the noise floor as magnitudes in `scale`, like prefix
+	u32            peak_count;
+	Peak           peaks[MAX_PEAKS]; // strongest first, see peaks.cpp
+	u32            pitch_count;
+	PitchEstimate  pitch[MAX_FRAMES_PER_ROUND]; // one per frame of the round, see pitch.cpp
+	bool           cross_valid;           // averages against a reference device, see cross.cpp
+	u32            cross_reference;
+	u32            cross_frames;
+	f32*           cross_reference_power;
+	f32*           cross_power;
+	fftwf_complex* cross;
+	bool           delay_valid;      // see delay.cpp
+	f32            delay;            // samples the device lags the reference, full rate
+	f32            delay_confidence;
+	u32            band_count;       // fractional octave levels in dB, 0 when not analyzed, see octave.cpp
+	u32            band_key;         // octave_key of the layout they belong to
+	f32            band_levels[MAX_BANDS];
+};
+
+struct SpectrumBuffers {
+	SpectrumSlot slots[2];
+	u32          front;
+	u32          sequence; // incremented with every flip
+};
+
+global FFTBatch s_fft_batch;
+global FFTPlan  s_fft_plans[FFT_SIZE_COUNT];
+global u32      s_fft_size_index = 4;
+
+// distance between two devices' spectra, padded so every slice keeps the 32 byte alignment fftw planned with
+u32 fft_bin_stride(u32 fft_size)
+{
+	return (fft_size / 2 + 1 + 3) & ~3u;
+}
+
+f32* fft_input(u32 device, u32 fft_size)
+{
+	return s_fft_batch.in + device * fft_size;
+}
+
+fftwf_complex* fft_output(u32 device, u32 fft_size)
+{
+	return s_fft_batch.out + device * fft_bin_stride(fft_size);
+}
+
+enum PlanQuality : u32 {
+	PLAN_ESTIMATE,
+	PLAN_MEASURE,
+	PLAN_PATIENT,
+
+	PLAN_QUALITY_COUNT,
+};
+
+global const char* s_plan_quality_names[PLAN_QUALITY_COUNT] = { "estimate", "measure", "patient" };
+global const u32   s_plan_quality_flags[PLAN_QUALITY_COUNT] = { FFTW_ESTIMATE, FFTW_MEASURE, FFTW_PATIENT };
+
+struct PlanReport {
+	bool wisdom_loaded;
+	u32  plans_created;
+	f64  planning_seconds;
+};
+
+global PlanQuality s_plan_quality = PLAN_ESTIMATE;
+global bool        s_use_wisdom_cache = true;
+global PlanReport  s_plan_report;
+global char        s_wisdom_path[MAX_PATH];
+
+// reads '-measure', '-patient' and '-nowisdom' from the command line
+void parse_fft_options(char* command_line)
+{
+	if(strstr(command_line, "-measure")) s_plan_quality = PLAN_MEASURE;
+	if(strstr(command_line, "-patient")) s_plan_quality = PLAN_PATIENT;
+	if(strstr(command_line, "-nowisdom")) s_use_wisdom_cache = false;
+}
+
+//NOTE: estimated plans don't produce wisdom worth keeping, so the cache is only touched for measured ones
+void load_fft_wisdom()
+{
+	if(s_plan_quality == PLAN_ESTIMATE || !s_use_wisdom_cache) return;
+
+	get_executable_relative_path(s_wisdom_path, sizeof(s_wisdom_path), "spectrum.wisdom");
+	s_plan_report.wisdom_loaded = fftwf_import_wisdom_from_filename(s_wisdom_path);
+}
+
+void save_fft_wisdom()
+{
+	if(s_plan_quality == PLAN_ESTIMATE || !s_use_wisdom_cache) return;
+
+	if(!fftwf_export_wisdom_to_filename(s_wisdom_path)) {
+		OutputDebugString("failed to write fftw wisdom\n");
+	}
+}
+
+void allocate_spectrum_buffers(SpectrumBuffers* buffers)
+{
+	for(u32 i = 0; i < 2; i++) {
+		buffers->slots[i].bins       = fftwf_alloc_complex(MAX_FFT_SIZE / 2 + 1);
+		buffers->slots[i].magnitudes = (f32*)r_allocate((MAX_FFT_SIZE / 2 + 1) * sizeof(f32));
+		buffers->slots[i].decibels   = (f32*)r_allocate((MAX_FFT_SIZE / 2 + 1) * sizeof(f32));
+		buffers->slots[i].prefix     = (f64*)r_allocate((MAX_FFT_SIZE / 2 + 2) * sizeof(f64));
+		buffers->slots[i].cqt        = (f32*)r_allocate(MAX_CQT_BINS * sizeof(f32));
+		buffers->slots[i].zoom       = (f32*)r_allocate(MAX_ZOOM_BINS * sizeof(f32));
+		buffers->slots[i].psd          = (f32*)r_allocate((MAX_FFT_SIZE / 2 + 1) * sizeof(f32));
+		buffers->slots[i].noise_floor  = (f32*)r_allocate((MAX_FFT_SIZE / 2 + 1) * sizeof(f32));
+		buffers->slots[i].noise_prefix = (f64*)r_allocate((MAX_FFT_SIZE / 2 + 2) * sizeof(f64));
+		buffers->slots[i].cross_reference_power = (f32*)r_allocate((MAX_FFT_SIZE / 2 + 1) * sizeof(f32));
+		buffers->slots[i].cross_power           = (f32*)r_allocate((MAX_FFT_SIZE / 2 + 1) * sizeof(f32));
+		buffers->slots[i].cross                 = fftwf_alloc_complex(MAX_FFT_SIZE / 2 + 1);
+		memset(buffers->slots[i].bins, 0, sizeof(fftwf_complex) * (MAX_FFT_SIZE / 2 + 1));
+	}
+}
+
+void rebuild_fft_windows()
+{
+	for(u32 i = 0; i < FFT_SIZE_COUNT; i++) {
+		FFTPlan& plan = s_fft_plans[i];
+		fill_window(s_window_function, plan.window, plan.size);
+		plan.window_sum   = window_sum(plan.window, plan.size);
+		plan.window_power = window_power(plan.window, plan.size);
+	}
+}
+
+//NOTE: single device plans get created on the first slice and are later executed on any slice with fftwf_execute_dft_r2c,
+// slices keep the alignment of the batch buffers so that is allowed. Measuring overwrites the buffers, so this has to happen before they get filled.
+void create_fft_plans(u32 device_count)
+{
+	s_fft_batch.device_count = device_count;
+	u32 slices = max(device_count, 1u);
+	s_fft_batch.in  = fftwf_alloc_real(slices * MAX_FFT_SIZE);
+	s_fft_batch.out = fftwf_alloc_complex(slices * fft_bin_stride(MAX_FFT_SIZE));
+
+	for(u32 i = 0; i < FFT_SIZE_COUNT; i++) {
+		FFTPlan& plan = s_fft_plans[i];
+		plan.size   = s_fft_sizes[i];
+		plan.window = (f32*)r_allocate(plan.size * sizeof(f32));
+
+		f64 start = get_seconds();
+		plan.plan = fftwf_plan_dft_r2c_1d(plan.size, s_fft_batch.in, s_fft_batch.out, s_plan_quality_flags[s_plan_quality]);
+		s_plan_report.plans_created++;
+		if(device_count > 1) {
+			i32 n = plan.size;
+			plan.batch_plan = fftwf_plan_many_dft_r2c(1, &n, device_count,
+				s_fft_batch.in,  0, 1, plan.size,
+				s_fft_batch.out, 0, 1, fft_bin_stride(plan.size),
+				s_plan_quality_flags[s_plan_quality]);
+			s_plan_report.plans_created++;
+		}
+		s_plan_report.planning_seconds += get_seconds() - start;
+	}
+
+	memset(s_fft_batch.in, 0, sizeof(f32) * slices * MAX_FFT_SIZE);
+
+	rebuild_fft_windows();
+}
+
+const char* wisdom_state_name()
+{
+	if(s_plan_quality == PLAN_ESTIMATE || !s_use_wisdom_cache) return "unused";
+	return s_plan_report.wisdom_loaded ? "loaded" : "missing";
+}
+
+// planning time of this run, compare a run with '-nowisdom' against a normal one to see what the cache saves
+s8 format_fft_planning_report(s8 dst)
+{
+	return format(to_s("fft planning: %d plans in %d ms (%s, wisdom %s)"), dst,
+		s_plan_report.plans_created, (i32)(s_plan_report.planning_seconds * 1000), s_plan_quality_names[s_plan_quality], wisdom_state_name());
+}
@@ -0,0 +1,225 @@
+#pragma once
+#include <atomic>
+#include <math.h>
+#include "basetypes.h"
+#include "platform.h"
+#include "stft.cpp"
+#include "simd.cpp"
+
+///////////////////////////////////////////////////////////
+//                    Loudness Metering                  //
+///////////////////////////////////////////////////////////
+
+//NOTE: itu-r bs.1770 loudness and true peak of every device, on the capture thread right as the samples come in like the tone
+// tracker. Nothing gets copied, the kernels read the capture buffer.
+//  loudness  - k-weighting (a high shelf and a high pass biquad) and the mean square of the result per LOUDNESS_STEP_MS step.
+//              Momentary loudness covers the last 4 steps, short term the last 30, both in LUFS. Integrated loudness gates
+//              the 400 ms blocks that start every step: absolute at -70 LUFS, then relative 10 LU below the mean of what passed.
+//              The blocks go into a histogram of LOUDNESS_HISTOGRAM_STEP LU bins with their summed energy, so the gate gets
+//              re-evaluated over any duration in constant memory.
+//  true peak - 4x oversampled with a 48 tap kaiser windowed sinc, in dBTP.
+// A device's meter starts over once it sees a new s_loudness_reset.
+global const u32 LOUDNESS_STEP_MS          = 100;
+global const u32 MOMENTARY_STEPS           = 4;
+global const u32 SHORT_TERM_STEPS          = 30;
+global const f32 LOUDNESS_OFFSET           = -0.691f; // bs.1770 calibration, a full scale 997 Hz sine reads -3.01 LUFS
+global const f32 LOUDNESS_ABSOLUTE_GATE    = -70.0f;
+global const f32 LOUDNESS_RELATIVE_GATE    = -10.0f;
+global const f32 LOUDNESS_HISTOGRAM_STEP   = 0.1f;
+global const u32 LOUDNESS_HISTOGRAM_BINS   = 800;     // from the absolute gate up to +10 LUFS
+global const f32 LOUDNESS_SILENCE          = -120.0f; // reported instead of -inf
+global const f64 TRUE_PEAK_KAISER_BETA     = 5.0; // within 0.1 dB up to 0.38 of the rate, 16.7 kHz at 44.1 kHz
+
+struct LoudnessMeter {
+	u32 reset_generation;
+	f32 filter_state[4];
+	u32 step_position;
+	f64 step_energy;                   // of the k-weighted samples of the current step
+	f64 steps[SHORT_TERM_STEPS];       // mean squares of the last finished steps
+	u32 step_index;
+	u32 step_count;                    // up to SHORT_TERM_STEPS
+	u32 histogram_counts[LOUDNESS_HISTOGRAM_BINS];
+	f64 histogram_energy[LOUDNESS_HISTOGRAM_BINS];
+	i16 history[TRUE_PEAK_TAPS - 1];   // the true peak filter's input before the current capture
+	f32 step_peak;
+	f32 peak_max;
+	// published for the ui thread, in LUFS and dBTP
+	std::atomic<f32> momentary;
+	std::atomic<f32> short_term;
+	std::atomic<f32> integrated;
+	std::atomic<f32> true_peak;        // of the last step
+	std::atomic<f32> true_peak_max;    // since the last reset
+};
+
+global BiquadCascade    s_k_weighting;
+global u32              s_loudness_step_samples;
+global f32              s_true_peak_taps[TRUE_PEAK_PHASES * TRUE_PEAK_TAPS];
+global std::atomic<u32> s_loudness_reset;
+global bool             s_show_loudness;
+
+//NOTE: the k-weighting filters for any sample rate from their analog prototypes, at 48 kHz these are the coefficients the
+// standard lists
+void init_loudness(u32 sample_rate)
+{
+	f64 coefficients[2][5];
+
+	// high shelf, +4 dB above about 1.5 kHz
+	f64 k  = tan(PI * 1681.974450955533 / sample_rate);
+	f64 q  = 0.7071752369554196;
+	f64 vh = pow(10.0, 3.999843853973347 / 20);
+	f64 vb = pow(vh, 0.4996667741545416);
+	f64 a0 = 1 + k / q + k * k;
+	coefficients[0][0] = (vh + vb * k / q + k * k) / a0;
+	coefficients[0][1] = 2 * (k * k - vh) / a0;
+	coefficients[0][2] = (vh - vb * k / q + k * k) / a0;
+	coefficients[0][3] = 2 * (k * k - 1) / a0;
+	coefficients[0][4] = (1 - k / q + k * k) / a0;
+
+	// high pass at 38 Hz
+	k  = tan(PI * 38.13547087602444 / sample_rate);
+	q  = 0.5003270373238773;
+	a0 = 1 + k / q + k * k;
+	coefficients[1][0] = 1;
+	coefficients[1][1] = -2;
+	coefficients[1][2] = 1;
+	coefficients[1][3] = 2 * (k * k - 1) / a0;
+	coefficients[1][4] = (1 - k / q + k * k) / a0;
+
+	build_biquad_cascade(&s_k_weighting, coefficients);
+	s_loudness_step_samples = sample_rate * LOUDNESS_STEP_MS / 1000;
+
+	// tap n of the prototype sits at 4 * j + p, every phase on its own has unity gain at dc. The prototype is centered on a tap
+	// instead of between the middle two so the phases land on the samples and a quarter, half and three quarters past them,
+	// phase 0 passes the samples through and the true peak never reads below the sample peak.
+	f64 center = TRUE_PEAK_PHASES * (TRUE_PEAK_TAPS / 2);
+	for(u32 p = 0; p < TRUE_PEAK_PHASES; p++) {
+		f64 sum = 0;
+		for(u32 j = 0; j < TRUE_PEAK_TAPS; j++) {
+			f64 offset = (TRUE_PEAK_PHASES * j + p - center) / TRUE_PEAK_PHASES;
+			f64 r = (TRUE_PEAK_PHASES * j + p - center) / (center + 1);
+			f64 window = bessel_i0(TRUE_PEAK_KAISER_BETA * sqrt(1 - r * r)) / bessel_i0(TRUE_PEAK_KAISER_BETA);
+			f64 tap = offset == 0 ? 1 : window * sin(PI * offset) / (PI * offset);
+			s_true_peak_taps[p * TRUE_PEAK_TAPS + j] = (f32)tap;
+			sum += tap;
+		}
+		for(u32 j = 0; j < TRUE_PEAK_TAPS; j++) s_true_peak_taps[p * TRUE_PEAK_TAPS + j] /= (f32)sum;
+	}
+}
+
+// mean square of full scale samples to LUFS
+f32 loudness_from_mean_square(f64 mean_square)
+{
+	if(mean_square <= 0) return LOUDNESS_SILENCE;
+	return max(LOUDNESS_OFFSET + 10 * (f32)log10(mean_square), LOUDNESS_SILENCE);
+}
+
+f32 true_peak_to_decibels(f32 peak)
+{
+	if(peak <= 0) return LOUDNESS_SILENCE;
+	return max(20 * log10f(peak / 32768.0f), LOUDNESS_SILENCE);
+}
+
+void reset_loudness_meter(LoudnessMeter* meter, u32 generation)
+{
+	meter->reset_generation = generation;
+	memset(meter->filter_state, 0, sizeof(meter->filter_state));
+	meter->step_position = 0;
+	meter->step_energy   = 0;
+	meter->step_index    = 0;
+	meter->step_count    = 0;
+	memset(meter->histogram_counts, 0, sizeof(meter->histogram_counts));
+	memset(meter->histogram_energy, 0, sizeof(meter->histogram_energy));
+	memset(meter->history, 0, sizeof(meter->history));
+	meter->step_peak = 0;
+	meter->peak_max  = 0;
+	meter->momentary.store(LOUDNESS_SILENCE, std::memory_order_relaxed);
+	meter->short_term.store(LOUDNESS_SILENCE, std::memory_order_relaxed);
+	meter->integrated.store(LOUDNESS_SILENCE, std::memory_order_relaxed);
+	meter->true_peak.store(LOUDNESS_SILENCE, std::memory_order_relaxed);
+	meter->true_peak_max.store(LOUDNESS_SILENCE, std::memory_order_relaxed);
+}
+
+// mean square of the last `steps` finished steps, or of as many as there are
+f64 mean_of_steps(LoudnessMeter* meter, u32 steps)
+{
+	steps = min(steps, meter->step_count);
+	if(!steps) return 0;
+	f64 sum = 0;
+	for(u32 s = 0; s < steps; s++) sum += meter->steps[(meter->step_index + SHORT_TERM_STEPS - 1 - s) % SHORT_TERM_STEPS];
+	return sum / steps;
+}
+
+f32 integrated_loudness(LoudnessMeter* meter)
+{
+	f64 energy = 0;
+	u64 count  = 0;
+	for(u32 b = 0; b < LOUDNESS_HISTOGRAM_BINS; b++) {
+		energy += meter->histogram_energy[b];
+		count  += meter->histogram_counts[b];
+	}
+	if(!count) return LOUDNESS_SILENCE;
+
+	// bins are only kept whole, the relative gate is exact to LOUDNESS_HISTOGRAM_STEP
+	f32 gate  = loudness_from_mean_square(energy / count) + LOUDNESS_RELATIVE_GATE;
+	u32 first = (u32)max(ceilf((gate - LOUDNESS_ABSOLUTE_GATE) / LOUDNESS_HISTOGRAM_STEP), 0.0f);
+	energy = 0;
+	count  = 0;
+	for(u32 b = first; b < LOUDNESS_HISTOGRAM_BINS; b++) {
+		energy += meter->histogram_energy[b];
+		count  += meter->histogram_counts[b];
+	}
+	return count ? loudness_from_mean_square(energy / count) : LOUDNESS_SILENCE;
+}
+
+void finish_loudness_step(LoudnessMeter* meter)
+{
+	f64 full_scale = 32768.0 * 32768.0;
+	meter->steps[meter->step_index] = meter->step_energy / (s_loudness_step_samples * full_scale);
+	meter->step_index = (meter->step_index + 1) % SHORT_TERM_STEPS;
+	meter->step_count = min(meter->step_count + 1, SHORT_TERM_STEPS);
+	meter->step_position = 0;
+	meter->step_energy   = 0;
+
+	f64 block = mean_of_steps(meter, MOMENTARY_STEPS);
+	f32 block_loudness = loudness_from_mean_square(block);
+	if(meter->step_count >= MOMENTARY_STEPS && block_loudness > LOUDNESS_ABSOLUTE_GATE) {
+		u32 bin = min((u32)((block_loudness - LOUDNESS_ABSOLUTE_GATE) / LOUDNESS_HISTOGRAM_STEP), LOUDNESS_HISTOGRAM_BINS - 1);
+		meter->histogram_counts[bin]++;
+		meter->histogram_energy[bin] += block;
+	}
+
+	meter->peak_max = max(meter->peak_max, meter->step_peak);
+	meter->momentary.store(block_loudness, std::memory_order_relaxed);
+	meter->short_term.store(loudness_from_mean_square(mean_of_steps(meter, SHORT_TERM_STEPS)), std::memory_order_relaxed);
+	meter->integrated.store(integrated_loudness(meter), std::memory_order_relaxed);
+	meter->true_peak.store(true_peak_to_decibels(meter->step_peak), std::memory_order_relaxed);
+	meter->true_peak_max.store(true_peak_to_decibels(meter->peak_max), std::memory_order_relaxed);
+	meter->step_peak = 0;
+}
+
+void process_loudness(LoudnessMeter* meter, const i16* samples, u32 count)
+{
+	u32 generation = s_loudness_reset.load(std::memory_order_acquire);
+	if(meter->reset_generation != generation) reset_loudness_meter(meter, generation);
+	if(!count) return;
+
+	// the first outputs need the previous capture's samples, only those get spliced together
+	u32 overlap = TRUE_PEAK_TAPS - 1;
+	u32 spliced = min(count, overlap);
+	i16 splice[2 * (TRUE_PEAK_TAPS - 1)];
+	memcpy(splice, meter->history, overlap * sizeof(i16));
+	memcpy(splice + overlap, samples, spliced * sizeof(i16));
+	f32 peak = true_peak_i16(splice + overlap, spliced, s_true_peak_taps);
+	if(count > overlap) peak = max(peak, true_peak_i16(samples + overlap, count - overlap, s_true_peak_taps));
+	if(count >= overlap) memcpy(meter->history, samples + count - overlap, overlap * sizeof(i16));
+	else                 memcpy(meter->history, splice + spliced, overlap * sizeof(i16));
+	meter->step_peak = max(meter->step_peak, peak);
+
+	for(u32 done = 0; done < count;) {
+		u32 length = min(count - done, s_loudness_step_samples - meter->step_position);
+		meter->step_energy += biquad_cascade_energy_i16(samples + done, length, &s_k_weighting, meter->filter_state);
+		meter->step_position += length;
+		done += length;
+		if(meter->step_position == s_loudness_step_samples) finish_loudness_step(meter);
+	}
+}
@@ -2,35 +2,95 @@
 #include "basetypes.h"
 #include "text.cpp"
 #include "platform_win32.cpp"
-
-#undef global
+#include "stft.cpp"
+#include "fft.cpp"
+#include "simd.cpp"
+#include "sample_ring.cpp"
+#include "workers.cpp"
+#include "bin_map.cpp"
+#include "cqt.cpp"
+#include "zoom.cpp"
+#include "decimate.cpp"
+#include "multires.cpp"
+#include "tones.cpp"
+#include "psd.cpp"
+#include "peaks.cpp"
+#include "pitch.cpp"
+#include "cross.cpp"
+#include "delay.cpp"
+#include "loudness.cpp"
+#include "octave.cpp"
+#include "mfcc.cpp"
 
 #include <assert.h>
-#include <complex.h>
-#include <fftw3.h>
-
-#define global static
-
-struct FFTWData {
-	fftw_complex* in;
-	fftw_complex* out;
-	fftw_plan     plan;
-};
 
 global const u32          MAX_CAPTURE_DEVICES  = 8;
 global const u32          s_samples_per_second = 44100;
 global u32                s_buffered_seconds   = 5;
 global i32                s_device_count = 0;
 global Win32CaptureDevice s_capture_devices[MAX_CAPTURE_DEVICES];
+global SampleRing         s_sample_rings[MAX_CAPTURE_DEVICES];
+global std::atomic<bool>  s_capture_running;
+global void*              s_capture_thread;
 global u32*               s_max_spectrum_values;
 global u32*               s_max_sample_values;
 global u32                s_device_colors[MAX_CAPTURE_DEVICES] = { 0x000000ff, 0x0000ff00, 0x00ff0000, 0x000000ff, 0x0000ff00, 0x00ff0000, 0x000000ff, 0x0000ff00 };
 
-global const u32 s_fft_buckets = s_samples_per_second / 4;
-global FFTWData  s_fftw_buffers[MAX_CAPTURE_DEVICES];
+global StftState       s_stft_states[MAX_CAPTURE_DEVICES];
+global ZoomState       s_zoom_states[MAX_CAPTURE_DEVICES];
+global DecimatorState  s_decimators[MAX_CAPTURE_DEVICES];
+global MultiresState   s_multires[MAX_CAPTURE_DEVICES];
+global PsdState        s_psd_states[MAX_CAPTURE_DEVICES];
+global PeakTracker     s_peak_trackers[MAX_CAPTURE_DEVICES];
+global PitchState      s_pitch_states[MAX_CAPTURE_DEVICES];
+global CrossSpectrum   s_cross_spectra[MAX_CAPTURE_DEVICES];
+global DelayState      s_delay_states[MAX_CAPTURE_DEVICES];
+global ToneBank        s_tone_banks[MAX_CAPTURE_DEVICES]; // only touched by the capture thread besides the published levels
+global LoudnessMeter   s_loudness_meters[MAX_CAPTURE_DEVICES]; // same
+global FilterBankState s_filter_banks[MAX_CAPTURE_DEVICES];
+global MfccState       s_mfcc_states[MAX_CAPTURE_DEVICES];
+global FeatureStream   s_feature_streams[MAX_CAPTURE_DEVICES];
+global SpectrumBuffers s_spectra[MAX_CAPTURE_DEVICES];
+
+// the set of fft jobs submitted by one update, a new round only starts once the previous one finished
+struct AnalysisRound {
+	bool             in_flight;
+	bool             batched;
+	u32              size_index;
+	u32              decimation_stages; // the fft runs decimation_stages sizes smaller on the decimated stream
+	SpectrumScale    scale;
+	FrequencyAxis    axis;
+	bool             zoomed;
+	bool             cqt_kernels_fit;   // s_cqt_kernels were built for this round's size and window
+	bool             multi_resolution;
+	PsdAveraging     averaging;
+	PeakInterpolation peak_interpolation;
+	PitchMethod      pitch_method;
+	bool             cross_analysis;
+	u32              cross_reference;
+	bool             delay_estimation;
+	bool             bands;
+	BandMethod       band_method;
+	bool             features;
+	u32              psd_key;           // see psd_key, also covers the window the round runs with
+	u32              sequence;
+	std::atomic<u64> work_microseconds;
+};
+
+global AnalysisRound s_analysis_round;
+global bool          s_windows_dirty; // rebuilt between rounds since the jobs read them
+global f64           s_round_work_seconds; // smoothed cpu time the fft jobs of one round took
+global u32           s_batched_executions; // rounds
+global u32           s_single_executions;  // device jobs
+
+// frequency of the last bin (n / 2) of an r2c transform of the given size
+f32 fft_frequency_max(u32 fft_size)
+{
+	return (f32)(fft_size / 2) * s_samples_per_second / fft_size;
+}
 
-global u32         s_computed_frequency_max = ((s_fft_buckets - 1.0f) / s_fft_buckets * s_samples_per_second) / 2;
-global u32         s_src_frequency_min      = 0;
+global u32         s_computed_frequency_max = fft_frequency_max(s_fft_sizes[s_fft_size_index]);
+global f32         s_src_frequency_min      = 0;
 global ConfigValue s_src_frequency_max      = {
 	.min     = 100,
 	.current = (f32)s_computed_frequency_max,
@@ -41,6 +101,15 @@ global ConfigValue s_spectrum_amplification = {
 	.current = 1.0f,
 	.max     = 100.0f,
 };
+global SpectrumScale s_spectrum_scale = SPECTRUM_SCALE_LINEAR;
+global FrequencyAxis s_frequency_axis = FREQUENCY_AXIS_LINEAR;
+global bool          s_multi_resolution; // see multires.cpp, only on the linear axis
+// in decibel scale the spectrum shows [-range, 0] dBFS, shifted up by the amplification
+global ConfigValue s_dynamic_range = {
+	.min     = 20.0f,
+	.current = 80.0f,
+	.max     = 160.0f,
+};
 
 global u32*      s_waterfall_output_row_buffer;
 
@@ -50,12 +119,71 @@ global ConfigValue s_max_sample_abs = {
 	.max     = 32767.0f,
 };
 global u32         s_topmost_spectrum = 0;
+global f32         s_mouse_frequency; // frequency under the mouse while it is over the spectrum, 0 otherwise
 
 u32 limit(u32 value, u32 max)
 {
 	return value > max ? max : value;
 }
 
+void select_fft_size(u32 size_index)
+{
+	s_fft_size_index = size_index;
+	s_computed_frequency_max = fft_frequency_max(s_fft_sizes[size_index]);
+	s_src_frequency_max.max = (f32)s_computed_frequency_max;
+	if(s_src_frequency_max.current > s_src_frequency_max.max) s_src_frequency_max.current = s_src_frequency_max.max;
+	if(s_src_frequency_min >= s_src_frequency_max.current) s_src_frequency_min = 0;
+}
+
+// moves the displayed range by half its width, `direction` is 1 or -1
+void slide_frequency_range(f32 direction)
+{
+	f32 shift = (s_src_frequency_max.current - s_src_frequency_min) / 2;
+	if(direction < 0) shift = -min(shift, s_src_frequency_min);
+	else              shift =  min(shift, s_src_frequency_max.max - s_src_frequency_max.current);
+	s_src_frequency_min         += shift;
+	s_src_frequency_max.current += shift;
+}
+
+// column of `frequency` in the spectrum section, -1 if it is outside the displayed range
+i32 frequency_to_column(f32 frequency, u32 w)
+{
+	f32 position;
+	if(s_frequency_axis == FREQUENCY_AXIS_CONSTANT_Q) {
+		if(s_cqt_kernels->bin_count < 2 || frequency < s_cqt_kernels->frequency_min) return -1;
+		position = log2f(frequency / s_cqt_kernels->frequency_min) * CQT_BINS_PER_OCTAVE / (s_cqt_kernels->bin_count - 1);
+	}
+	else {
+		position = (frequency - s_src_frequency_min) / (s_src_frequency_max.current - s_src_frequency_min);
+	}
+	if(position < 0 || position >= 1) return -1;
+	return (i32)(position * w);
+}
+
+// height in the spectrum section of an amplitude / 2 level, on the scale the spectrum is shown in
+f32 level_to_display(f32 level)
+{
+	if(s_spectrum_scale == SPECTRUM_SCALE_DECIBEL) {
+		f32 range  = s_dynamic_range.current;
+		f32 offset = 20.0f * log10f(s_spectrum_amplification.current) + range;
+		return max((20.0f * log10f(max(level, 1e-6f) / (32768.0f / 2)) + offset) / range, 0.0f);
+	}
+	return level * s_spectrum_amplification.current;
+}
+
+// format() only takes non-negative integers, a signed value with one decimal goes in as its sign, whole part and tenths
+struct Tenths {
+	const char* sign;
+	i32         whole;
+	i32         tenths;
+};
+
+Tenths to_tenths(f32 value)
+{
+	u32 tenths = (u32)(fabsf(value) * 10 + 0.5f);
+	return { value < 0 && tenths ? "-" : "", (i32)(tenths / 10), (i32)(tenths % 10) };
+}
+
 void window_resized(u32 w, u32 h)
 {
 	for(u32 i = 0; i < MAX_CAPTURE_DEVICES; i++) {
@@ -89,12 +217,21 @@ void key_down(u32 key_code)
 
 		case 0x4E: { //N
 			s_src_frequency_max.current = cf_halve(s_src_frequency_max);
+			if(s_src_frequency_min >= s_src_frequency_max.current) s_src_frequency_min = 0;
 		} break;
 
 		case 0x4D: { // M
 			s_src_frequency_max.current = cf_double(s_src_frequency_max);
 		} break;
 
+		case VK_PRIOR: {
+			slide_frequency_range(1);
+		} break;
+
+		case VK_NEXT: {
+			slide_frequency_range(-1);
+		} break;
+
 		case VK_OEM_COMMA: {
 			s_spectrum_amplification.current = cf_halve(s_spectrum_amplification);
 		} break;
@@ -102,59 +239,520 @@ void key_down(u32 key_code)
 		case VK_OEM_PERIOD: {
 			s_spectrum_amplification.current = cf_double(s_spectrum_amplification);
 		} break;
+
+		case VK_OEM_4: { // [
+			s_stft_hop.current = cf_halve(s_stft_hop);
+		} break;
+
+		case VK_OEM_6: { // ]
+			s_stft_hop.current = cf_double(s_stft_hop);
+		} break;
+
+		case 0x57: { // W
+			s_window_function = (WindowFunction)((s_window_function + 1) % WINDOW_FUNCTION_COUNT);
+			s_windows_dirty = true;
+		} break;
+
+		case 0x44: { // D
+			s_spectrum_scale = (SpectrumScale)((s_spectrum_scale + 1) % SPECTRUM_SCALE_COUNT);
+		} break;
+
+		case 0x45: { // E
+			s_dynamic_range.current = cf_halve(s_dynamic_range);
+		} break;
+
+		case 0x52: { // R
+			s_dynamic_range.current = cf_double(s_dynamic_range);
+		} break;
+
+		case 0x4C: { // L
+			s_frequency_axis = (FrequencyAxis)((s_frequency_axis + 1) % FREQUENCY_AXIS_COUNT);
+		} break;
+
+		case 0x56: { // V
+			s_multi_resolution = !s_multi_resolution;
+		} break;
+
+		case 0x41: { // A
+			s_psd_averaging = (PsdAveraging)((s_psd_averaging + 1) % PSD_AVERAGING_COUNT);
+		} break;
+
+		case 0x46: { // F
+			s_show_noise_floor = !s_show_noise_floor;
+		} break;
+
+		case 0x50: { // P
+			s_show_peaks = !s_show_peaks;
+		} break;
+
+		case 0x49: { // I
+			s_peak_interpolation = (PeakInterpolation)((s_peak_interpolation + 1) % PEAK_INTERPOLATION_COUNT);
+		} break;
+
+		case 0x4B: { // K
+			s_pitch_method = (PitchMethod)((s_pitch_method + 1) % PITCH_METHOD_COUNT);
+		} break;
+
+		case 0x43: { // C
+			s_cross_analysis = !s_cross_analysis;
+		} break;
+
+		case 0x58: { // X
+			if(s_device_count > 0) s_cross_reference = (s_cross_reference + 1) % s_device_count;
+		} break;
+
+		case 0x4A: { // J
+			s_delay_estimation = !s_delay_estimation;
+		} break;
+
+		case 0x55: { // U
+			s_show_loudness = !s_show_loudness;
+		} break;
+
+		case 0x5A: { // Z
+			s_loudness_reset.fetch_add(1, std::memory_order_release);
+		} break;
+
+		case 0x42: { // B
+			s_show_bands = !s_show_bands;
+		} break;
+
+		case 0x4F: { // O
+			s_octave_fraction = (OctaveFraction)((s_octave_fraction + 1) % OCTAVE_FRACTION_COUNT);
+		} break;
+
+		case 0x51: { // Q
+			s_band_method = (BandMethod)((s_band_method + 1) % BAND_METHOD_COUNT);
+		} break;
+
+		case 0x53: { // S
+			s_extract_features = !s_extract_features;
+		} break;
+
+		case 0x54: { // T
+			if(s_mouse_frequency > 0) add_tone(s_mouse_frequency);
+		} break;
+
+		case 0x59: { // Y
+			clear_tones();
+		} break;
+
+		case 0x47: { // G
+			s_tone_block.current = cf_halve(s_tone_block);
+			s_tones_dirty = true;
+		} break;
+
+		case 0x48: { // H
+			s_tone_block.current = cf_double(s_tone_block);
+			s_tones_dirty = true;
+		} break;
+
+		case VK_OEM_MINUS: {
+			if(s_fft_size_index > 0) select_fft_size(s_fft_size_index - 1);
+		} break;
+
+		case VK_OEM_PLUS: {
+			if(s_fft_size_index < FFT_SIZE_COUNT - 1) select_fft_size(s_fft_size_index + 1);
+		} break;
 	}
 }
 
-void update()
+//NOTE: moves newly captured pcm of every device into its sample ring. This runs on its own thread so a slow frame can't delay
+// the reads, the analysis and render side only ever look at the rings.
+void capture_thread(void* data)
 {
-	for(u32 d = 0; d < MAX_CAPTURE_DEVICES; d++) {
-		Win32CaptureDevice& device = s_capture_devices[d];
-		if(!device.capture_buffer) continue;
+	while(s_capture_running.load(std::memory_order_relaxed)) {
+		u32 tone_generation;
+		ToneConfig* tones = acquire_tone_config(&tone_generation);
 
-		FFTWData& fftw = s_fftw_buffers[d];
-	
-		DWORD capture_pos;
-		DWORD read_pos;
-		if(FAILED(device.capture_buffer->GetCurrentPosition(&capture_pos, &read_pos))) {
-			return;
-		}
-		assert(read_pos % 2 == 0);
-		device.current_capture_read_progress = read_pos;
+		for(u32 d = 0; d < MAX_CAPTURE_DEVICES; d++) {
+			Win32CaptureDevice& device = s_capture_devices[d];
+			if(!device.capture_buffer) continue;
 
-		u32 block_size = s_fft_buckets * 2;
-		if(read_pos % block_size != 0) {
-			read_pos = read_pos / block_size * block_size;
+			DWORD capture_pos;
+			DWORD read_pos;
+			if(FAILED(device.capture_buffer->GetCurrentPosition(&capture_pos, &read_pos))) {
+				continue;
+			}
+			assert(read_pos % 2 == 0);
+
+			u32 new_bytes = (read_pos + device.capture_buffer_size - device.copied_capture_pos) % device.capture_buffer_size;
+			if(!new_bytes) continue;
+
+			LPVOID audio_memory_1;
+			DWORD  audio_memory_1_len;
+			LPVOID audio_memory_2;
+			DWORD  audio_memory_2_len;
+			if(FAILED(device.capture_buffer->Lock(device.copied_capture_pos, new_bytes, &audio_memory_1, &audio_memory_1_len, &audio_memory_2, &audio_memory_2_len, 0))) {
+				OutputDebugString("lock error");
+				continue;
+			}
+			assert(audio_memory_1_len + audio_memory_2_len == new_bytes);
+
+			SampleRing& ring = s_sample_rings[d];
+			ring_write(&ring, (i16*)audio_memory_1, audio_memory_1_len / 2);
+			ring_write(&ring, (i16*)audio_memory_2, audio_memory_2_len / 2);
+
+			process_tones(&s_tone_banks[d], tones, tone_generation, (i16*)audio_memory_1, audio_memory_1_len / 2);
+			process_tones(&s_tone_banks[d], tones, tone_generation, (i16*)audio_memory_2, audio_memory_2_len / 2);
+			process_loudness(&s_loudness_meters[d], (i16*)audio_memory_1, audio_memory_1_len / 2);
+			process_loudness(&s_loudness_meters[d], (i16*)audio_memory_2, audio_memory_2_len / 2);
+
+			device.capture_buffer->Unlock(audio_memory_1, audio_memory_1_len, audio_memory_2, audio_memory_2_len);
+			device.copied_capture_pos = read_pos;
 		}
 
-		static DWORD last_read_pos = -1;
-		if(read_pos != last_read_pos) {
-			last_read_pos = read_pos;
-		
-			i16* current_buffer_segment = device.samples_buffer + read_pos / 2;
+		release_tone_config(tone_generation);
+		sleep_milliseconds(1);
+	}
+}
 
-			{
-				u32 copy_size = s_fft_buckets * 2;
-				LPVOID audio_memory_1;
-				DWORD  audio_memory_1_len;
-				LPVOID audio_memory_2;
-				DWORD  audio_memory_2_len;
-				if(FAILED(device.capture_buffer->Lock((read_pos - copy_size) % device.capture_buffer_size, copy_size, &audio_memory_1, &audio_memory_1_len, &audio_memory_2, &audio_memory_2_len, 0 /*DSCBLOCK_ENTIREBUFFER*/))) {
-					OutputDebugString("lock error");
-					return;
-				}
-				assert(audio_memory_1_len + audio_memory_2_len == copy_size);
+// the plan the current round transforms with, smaller than the selected size when the stream is decimated
+FFTPlan& round_plan()
+{
+	return s_fft_plans[s_analysis_round.size_index - s_analysis_round.decimation_stages];
+}
 
-				memcpy(current_buffer_segment, audio_memory_1, audio_memory_1_len);
-				memcpy((u8*)current_buffer_segment + audio_memory_1_len, audio_memory_2, audio_memory_2_len);
+// runs the device's decimator up to the last frame of the round, from far enough back for the first frame if it has to restart
+void decimate_round(u32 d)
+{
+	StftState& stft = s_stft_states[d];
+	if(!s_analysis_round.decimation_stages || !stft.frame_count) return;
 
-				device.capture_buffer->Unlock(audio_memory_1, audio_memory_1_len, audio_memory_2, audio_memory_2_len);
-			}
+	u64 first_end = frame_end(&stft, 0);
+	decimate_until(&s_decimators[d], &s_sample_rings[d], s_analysis_round.decimation_stages,
+		frame_end(&stft, stft.frame_count - 1), first_end - min(first_end, (u64)MAX_FFT_SIZE));
+}
+
+void gather_frame(u32 d, FFTPlan& plan, u32 frame)
+{
+	f32* in = fft_input(d, plan.size);
+	if(s_analysis_round.decimation_stages) {
+		gather_decimated(&s_decimators[d], frame_end(&s_stft_states[d], frame), plan.window, in, plan.size);
+		return;
+	}
+	RingSpan span = ring_span(&s_sample_rings[d], frame_end(&s_stft_states[d], frame) - plan.size, plan.size);
+	convert_i16_to_f32_windowed(span.first, plan.window, in, span.first_length);
+	convert_i16_to_f32_windowed(span.second, plan.window + span.first_length, in + span.first_length, span.second_length);
+}
+
+// prefix sums of `magnitudes` in the slot's scale, a full scale sine ends up at 0 dBFS
+void publish_prefix(SpectrumSlot& slot, FFTPlan& plan, const f32* magnitudes, f64* prefix)
+{
+	u32 bin_count = plan.size / 2 + 1;
+	if(slot.scale == SPECTRUM_SCALE_DECIBEL) {
+		f32 full_scale = 32768.0f * plan.window_sum / 2;
+		magnitudes_to_decibels(magnitudes, slot.decibels, bin_count, -20.0f * log10f(full_scale));
+		compute_prefix_sums(slot.decibels, bin_count, prefix);
+	}
+	else {
+		compute_prefix_sums(magnitudes, bin_count, prefix);
+	}
+}
+
+void publish_magnitudes(SpectrumSlot& slot, FFTPlan& plan)
+{
+	publish_prefix(slot, plan, slot.magnitudes, slot.prefix);
+}
+
+// fractional octave levels as of `end`, a filter bank that has to start over does so from `restart`
+void publish_bands(u32 d, SpectrumSlot& slot, FFTPlan& plan, u64 end, u64 restart)
+{
+	slot.band_count = 0;
+	if(!s_analysis_round.bands) return;
+
+	if(s_analysis_round.band_method == BAND_METHOD_FFT) {
+		// the stitched bands of a multi-resolution round don't share one bin width
+		if(s_analysis_round.multi_resolution) return;
+		fft_band_levels(slot.magnitudes, plan, slot.band_levels);
+	}
+	else {
+		filter_bank_levels(&s_filter_banks[d], &s_sample_rings[d], end, restart, s_samples_per_second, slot.band_levels);
+	}
+	slot.band_key   = s_octave_key;
+	slot.band_count = s_octave_band_count;
+}
+
+// runs right after every transform, only the newest frame of a round gets published
+void process_frame(u32 d, FFTPlan& plan, u32 frame)
+{
+	StftState& stft = s_stft_states[d];
+	SpectrumBuffers& spectrum = s_spectra[d];
+	SpectrumSlot& slot = spectrum.slots[spectrum.front ^ 1];
+	u32 bin_count = plan.size / 2 + 1;
+	fftwf_complex* bins = fft_output(d, plan.size);
+
+	compute_magnitudes((f32*)bins, slot.magnitudes, bin_count);
+	accumulate_psd(&s_psd_states[d], slot.magnitudes, bin_count, s_analysis_round.psd_key, s_analysis_round.averaging);
+	f32 bin_width = (f32)(s_samples_per_second >> s_analysis_round.decimation_stages) / plan.size;
+	detect_peaks(&s_peak_trackers[d], slot.magnitudes, s_psd_states[d].noise, bin_count, bin_width, plan.window_sum, s_analysis_round.peak_interpolation);
+
+	PitchEstimate& pitch = slot.pitch[frame];
+	switch(s_analysis_round.pitch_method) {
+		case PITCH_METHOD_OFF: {
+			pitch = {};
+		} break;
+
+		case PITCH_METHOD_HPS: {
+			pitch = estimate_pitch_hps(&s_pitch_states[d], slot.magnitudes, bin_count, bin_width);
+		} break;
+
+		case PITCH_METHOD_YIN: {
+			pitch = estimate_pitch_yin(&s_pitch_states[d], &s_sample_rings[d], frame_end(&stft, frame), s_samples_per_second);
+		} break;
+	}
+	pitch.frame_end = frame_end(&stft, frame);
+
+	if(s_analysis_round.features) {
+		extract_features(&s_mfcc_states[d], &s_feature_streams[d], slot.magnitudes, plan, frame_end(&stft, frame), d, s_samples_per_second);
+	}
+
+	if(frame != stft.frame_count - 1) return;
+
+	slot.pitch_count = s_analysis_round.pitch_method != PITCH_METHOD_OFF ? stft.frame_count : 0;
+
+	slot.peak_count = s_peak_trackers[d].peak_count;
+	memcpy(slot.peaks, s_peak_trackers[d].peaks, sizeof(Peak) * slot.peak_count);
 
-			for(u32 i = 0; i < s_fft_buckets; i++) {
-				fftw.in[i][0] = current_buffer_segment[i];
+	memcpy(slot.bins, bins, sizeof(fftwf_complex) * bin_count);
+	slot.scale  = s_analysis_round.scale;
+	slot.axis   = s_analysis_round.axis;
+	slot.zoomed = s_analysis_round.zoomed;
+	const f32* noise_magnitudes = publish_psd(&s_psd_states[d], slot, plan, s_samples_per_second >> s_analysis_round.decimation_stages);
+	if(slot.axis == FREQUENCY_AXIS_CONSTANT_Q) {
+		// constant-Q bins are scaled so a sine of amplitude A gives A / 2. While the kernels for a new size or window are still
+		// being built there are none, the old ones would read the wrong bins.
+		slot.cqt_bin_count = 0;
+		if(s_analysis_round.cqt_kernels_fit) {
+			slot.cqt_bin_count = s_cqt_kernels->bin_count;
+			apply_cqt_kernels(s_cqt_kernels, bins, slot.cqt);
+			if(slot.scale == SPECTRUM_SCALE_DECIBEL) {
+				magnitudes_to_decibels(slot.cqt, slot.cqt, slot.cqt_bin_count, -20.0f * log10f(32768.0f / 2));
 			}
+		}
+	}
+	else if(slot.zoomed) {
+		slot.zoom_frequency_min = zoom_frequency_min(s_samples_per_second);
+		slot.zoom_bin_width     = zoom_bin_width(s_samples_per_second);
+		zoom_frame(&s_zoom_states[d], &s_sample_rings[d], frame_end(&stft, frame), s_samples_per_second, slot.zoom);
+		if(slot.scale == SPECTRUM_SCALE_DECIBEL) {
+			f32 full_scale = 32768.0f * s_zoom.window_sum / 2;
+			magnitudes_to_decibels(slot.zoom, slot.zoom, ZOOM_FFT_SIZE, -20.0f * log10f(full_scale));
+		}
+		compute_prefix_sums(slot.zoom, ZOOM_FFT_SIZE, slot.prefix);
+	}
+	else {
+		publish_magnitudes(slot, plan);
+		publish_prefix(slot, plan, noise_magnitudes, slot.noise_prefix);
+	}
+	u64 first_end = frame_end(&stft, 0);
+	publish_bands(d, slot, plan, frame_end(&stft, frame), first_end - min(first_end, (u64)MAX_FFT_SIZE));
+	slot.size_index = s_analysis_round.size_index - s_analysis_round.decimation_stages;
+	slot.decimation = 1 << s_analysis_round.decimation_stages;
+	slot.frame_end  = frame_end(&stft, frame);
+}
+
+// frames [first_frame, end_frame) of the device
+void transform_single_frames(u32 d, FFTPlan& plan, u32 first_frame, u32 end_frame)
+{
+	for(u32 frame = first_frame; frame < end_frame; frame++) {
+		gather_frame(d, plan, frame);
+		fftwf_execute_dft_r2c(plan.plan, fft_input(d, plan.size), fft_output(d, plan.size));
+		process_frame(d, plan, frame);
+	}
+}
+
+// multi-resolution rounds only publish the stitched bands, there are no per frame spectra
+void transform_multires(u32 d)
+{
+	StftState& stft = s_stft_states[d];
+	SpectrumSlot& slot = s_spectra[d].slots[s_spectra[d].front ^ 1];
+	u32 stitched_index = multires_stitched_size_index(s_analysis_round.size_index);
+
+	analyze_multires(&s_multires[d], d, &s_sample_rings[d], stft.consumed, s_analysis_round.size_index, slot.magnitudes);
+	slot.scale       = s_analysis_round.scale;
+	slot.axis        = FREQUENCY_AXIS_LINEAR;
+	slot.zoomed      = false;
+	slot.averaged    = false; // the bands' bin widths differ, there is no consistent density to average
+	slot.noise_valid = false;
+	slot.peak_count  = 0;
+	slot.pitch_count = 0;
+	clear_peaks(&s_peak_trackers[d]);
+	publish_magnitudes(slot, s_fft_plans[stitched_index]);
+	publish_bands(d, slot, s_fft_plans[stitched_index], stft.consumed, stft.consumed - min(stft.consumed, (u64)MAX_FFT_SIZE));
+	slot.size_index  = stitched_index;
+	slot.decimation  = 1;
+	slot.frame_end   = stft.consumed;
+}
+
+//NOTE: cross spectra only accumulate in batched rounds, the others publish the averages as they are so the display doesn't
+// flicker whenever a round can't be batched. Averages of a different size or window than the round's don't fit its slots.
+void publish_cross_analysis(u32 d, SpectrumSlot& slot)
+{
+	slot.cross_valid = false;
+	slot.delay_valid = false;
+	if(!s_analysis_round.cross_analysis || s_analysis_round.multi_resolution || s_cross_average.key != s_analysis_round.psd_key) return;
+
+	publish_cross(&s_cross_average, s_cross_spectra, d, slot);
+	if(s_analysis_round.delay_estimation && slot.cross_valid) {
+		estimate_delay(&s_delay_states[d], slot, s_analysis_round.size_index - s_analysis_round.decimation_stages,
+			1 << s_analysis_round.decimation_stages);
+	}
+}
+
+void fft_device_job(Job* job)
+{
+	f64 start = get_seconds();
+	FFTPlan& plan = round_plan();
+
+	if(s_analysis_round.multi_resolution) {
+		transform_multires(job->device);
+	}
+	else {
+		decimate_round(job->device);
+		transform_single_frames(job->device, plan, 0, s_stft_states[job->device].frame_count);
+	}
+	publish_cross_analysis(job->device, s_spectra[job->device].slots[s_spectra[job->device].front ^ 1]);
 
-			fftw_execute(fftw.plan);
+	s_analysis_round.work_microseconds.fetch_add((u64)((get_seconds() - start) * 1000000));
+}
+
+//NOTE: frames that end at the same position on every device go through the batched plan together, which also pairs them for
+// the cross spectra. A device that is a hop ahead of or behind the others gets its extra frames transformed on their own
+// before and after those, so pairing never shifts by whole hops.
+void fft_batch_job(Job* job)
+{
+	f64 start = get_seconds();
+	FFTPlan& plan = round_plan();
+
+	for(u32 d = 0; d < s_fft_batch.device_count; d++) decimate_round(d);
+
+	u32 first_frames[MAX_CAPTURE_DEVICES];
+	u32 paired_frames = pair_frames(s_stft_states, s_fft_batch.device_count, first_frames);
+	for(u32 d = 0; d < s_fft_batch.device_count; d++) transform_single_frames(d, plan, 0, first_frames[d]);
+
+	for(u32 i = 0; i < paired_frames; i++) {
+		for(u32 d = 0; d < s_fft_batch.device_count; d++) gather_frame(d, plan, first_frames[d] + i);
+		fftwf_execute(plan.batch_plan);
+		for(u32 d = 0; d < s_fft_batch.device_count; d++) process_frame(d, plan, first_frames[d] + i);
+		if(s_analysis_round.cross_analysis) {
+			accumulate_cross_spectra(&s_cross_average, s_cross_spectra, s_fft_batch.device_count, s_analysis_round.cross_reference,
+				plan.size, s_analysis_round.psd_key);
+		}
+	}
+	for(u32 d = 0; d < s_fft_batch.device_count; d++) {
+		transform_single_frames(d, plan, first_frames[d] + paired_frames, s_stft_states[d].frame_count);
+	}
+
+	for(u32 d = 0; d < s_fft_batch.device_count; d++) publish_cross_analysis(d, s_spectra[d].slots[s_spectra[d].front ^ 1]);
+
+	s_analysis_round.work_microseconds.fetch_add((u64)((get_seconds() - start) * 1000000));
+}
+
+void finish_analysis_round()
+{
+	for(u32 d = 0; d < s_fft_batch.device_count; d++) {
+		StftState& stft = s_stft_states[d];
+		if(!stft.frame_count) continue;
+		stft.frame_count = 0;
+
+		s_spectra[d].front ^= 1;
+		s_spectra[d].sequence++;
+
+		// keep enough history that the next frame can be taken at any size
+		if(stft.consumed > MAX_FFT_SIZE) ring_release(&s_sample_rings[d], stft.consumed - MAX_FFT_SIZE);
+	}
+
+	f64 work_seconds = s_analysis_round.work_microseconds.load() / 1000000.0;
+	s_round_work_seconds = s_round_work_seconds * 0.9 + work_seconds * 0.1;
+	s_analysis_round.in_flight = false;
+}
+
+//NOTE: the ui thread only decides which frames are due and hands them to the worker pool. While a round is still running no new
+// one gets started, hops that became due in the meantime are picked up by the next round.
+void update()
+{
+	// the tone tracker runs on the capture thread, its configuration doesn't wait for analysis rounds
+	if(s_tones_dirty && publish_tone_config(s_samples_per_second)) s_tones_dirty = false;
+
+	drain_feature_streams(s_feature_streams, s_fft_batch.device_count);
+
+	if(s_analysis_round.in_flight) {
+		if(!work_queue_finished(&s_work_queue)) return;
+		finish_analysis_round();
+	}
+
+	if(s_windows_dirty) {
+		rebuild_fft_windows();
+		invalidate_cqt_kernels();
+		s_windows_dirty = false;
+	}
+
+	FFTPlan& plan = s_fft_plans[s_fft_size_index];
+	if(s_frequency_axis == FREQUENCY_AXIS_CONSTANT_Q) {
+		update_cqt_kernels(plan.size, plan.window, s_samples_per_second, s_src_frequency_min, s_src_frequency_max.current);
+	}
+	if(s_show_bands) update_octave_bands(s_octave_fraction, s_samples_per_second);
+	bool multi_resolution = s_multi_resolution && s_frequency_axis == FREQUENCY_AXIS_LINEAR;
+	configure_zoom(s_frequency_axis == FREQUENCY_AXIS_LINEAR && !multi_resolution, s_samples_per_second, plan.size, s_window_function,
+		s_src_frequency_min, s_src_frequency_max.current);
+
+	// multi-resolution rounds follow the hop of the full rate band, the bands schedule their own frames within them
+	u32 hop = multi_resolution ? multires_hop(s_fft_size_index) : min((u32)s_stft_hop.current, plan.size);
+	u32 due_devices = 0;
+	u32 due_frames  = 0;
+	for(u32 d = 0; d < s_fft_batch.device_count; d++) {
+		u32 frames = schedule_frames(&s_stft_states[d], ring_available(&s_sample_rings[d]), plan.size, hop);
+		if(frames) due_devices++;
+		due_frames += frames;
+	}
+
+	if(!due_devices) return;
+
+	s_analysis_round.in_flight  = true;
+	s_analysis_round.size_index = s_fft_size_index;
+	s_analysis_round.decimation_stages = s_frequency_axis == FREQUENCY_AXIS_LINEAR && !multi_resolution
+		? select_decimation_stages(s_samples_per_second, s_src_frequency_max.current, plan.size, s_fft_sizes[0]) : 0;
+	s_analysis_round.scale      = s_spectrum_scale;
+	s_analysis_round.axis       = s_frequency_axis;
+	s_analysis_round.zoomed     = s_zoom.active;
+	s_analysis_round.cqt_kernels_fit = cqt_kernels_fit(s_cqt_kernels, plan.size, plan.window, s_samples_per_second);
+	s_analysis_round.multi_resolution = multi_resolution;
+	s_analysis_round.averaging  = s_psd_averaging;
+	s_analysis_round.peak_interpolation = s_peak_interpolation;
+	s_analysis_round.pitch_method = s_pitch_method;
+	// delays come from the cross spectra, estimating them keeps those running even when they aren't shown
+	s_analysis_round.cross_analysis   = (s_cross_analysis || s_delay_estimation) && s_fft_batch.device_count > 1;
+	s_analysis_round.cross_reference  = s_cross_reference;
+	s_analysis_round.delay_estimation = s_delay_estimation && s_fft_batch.device_count > 1;
+	s_analysis_round.bands       = s_show_bands;
+	s_analysis_round.band_method = s_band_method;
+	// multi-resolution rounds have no per frame spectra to take features from
+	s_analysis_round.features    = s_extract_features && !multi_resolution;
+	u32 round_size = s_fft_sizes[s_fft_size_index - s_analysis_round.decimation_stages];
+	f32 round_bin_width = (f32)(s_samples_per_second >> s_analysis_round.decimation_stages) / round_size;
+	if(s_show_bands) update_band_weights(round_bin_width, round_size / 2 + 1);
+	if(s_analysis_round.features) update_mel_filters(round_bin_width, round_size / 2 + 1);
+	s_analysis_round.psd_key    = psd_key(s_fft_size_index, s_analysis_round.decimation_stages, s_window_function);
+	s_analysis_round.sequence++;
+	s_analysis_round.work_microseconds.store(0);
+
+	//NOTE: when every device has a frame ready they all go through one batched job as long as a single core keeps up
+	// with that, i.e. it takes less than half the audio time the round covers. Otherwise, or when devices are out of phase,
+	// every device gets its own job so the pool can spread them over all cores. Cross analysis needs the batch regardless.
+	f64 round_seconds = (f64)hop * due_frames / due_devices / s_samples_per_second;
+	bool single_core_enough = s_work_queue.worker_count == 1 || s_round_work_seconds < round_seconds * 0.5;
+	s_analysis_round.batched = plan.batch_plan && !multi_resolution && due_devices == s_fft_batch.device_count
+		&& (single_core_enough || s_analysis_round.cross_analysis);
+	if(s_analysis_round.batched) {
+		submit_job(&s_work_queue, fft_batch_job, 0, s_analysis_round.sequence);
+		s_batched_executions++;
+	}
+	else {
+		for(u32 d = 0; d < s_fft_batch.device_count; d++) {
+			if(!s_stft_states[d].frame_count) continue;
+			submit_job(&s_work_queue, fft_device_job, d, s_analysis_round.sequence);
+			s_single_executions++;
 		}
 	}
 }
@@ -173,30 +771,64 @@ void render(RenderBuffer* buffer)
 		if(!device.capture_buffer) continue;
 		at_least_one = true;
 
-		FFTWData fftw = s_fftw_buffers[d];
+		SampleRing& ring = s_sample_rings[d];
 
-		static u32 last_read_pos[MAX_CAPTURE_DEVICES] = {};
-		if(device.current_capture_read_progress != last_read_pos[d]) {
-			last_read_pos[d] = device.current_capture_read_progress;
+		SpectrumSlot& spectrum = s_spectra[d].slots[s_spectra[d].front];
 
-			{
-				u32 buckets = s_fft_buckets / 2;
-				f32 scale = (f32)(s_src_frequency_max.current - s_src_frequency_min) / s_computed_frequency_max;
-				f32 offset = (f32)s_src_frequency_min / s_computed_frequency_max;
-				f32 block_length = (f32)buckets / buffer->w * scale;
+		static u32 last_sequence[MAX_CAPTURE_DEVICES] = {};
+		if(s_spectra[d].sequence != last_sequence[d]) {
+			last_sequence[d] = s_spectra[d].sequence;
+
+			if(spectrum.axis == FREQUENCY_AXIS_CONSTANT_Q) {
+				//NOTE: constant-Q bins are already log spaced, columns interpolate between the two nearest ones
+				f32 range  = s_dynamic_range.current;
+				f32 offset = 20.0f * log10f(s_spectrum_amplification.current) + range;
+				u32 count  = spectrum.cqt_bin_count;
 				for(u32 i = 0; i < buffer->w; i++) {
-					u32 first_freq = buckets * offset + block_length * i;
-					u32 last_freq  = buckets * offset + block_length * (i + 1);
-					if(last_freq == first_freq) last_freq = first_freq + 1;
-					f32 intensity_f = 0;
-					for(u32 j = first_freq; j < last_freq; j++) {
-						intensity_f += sqrt(fftw.out[j][0] * fftw.out[j][0] + fftw.out[j][1] * fftw.out[j][1]);
+					f32 new_value = 0;
+					if(count) {
+						f32 position = (f32)i * (count - 1) / max(buffer->w - 1, 1);
+						u32 bin      = (u32)position;
+						u32 next     = min(bin + 1, count - 1);
+						f32 value    = spectrum.cqt[bin] + (spectrum.cqt[next] - spectrum.cqt[bin]) * (position - bin);
+						new_value = spectrum.scale == SPECTRUM_SCALE_DECIBEL ? max((value + offset) / range, 0.0f) : value * s_spectrum_amplification.current;
 					}
-					f32 new_value = intensity_f / (s_fft_buckets * block_length) * s_spectrum_amplification.current;
 					// fade effect
 					device.spectrum_buffer[i] = max(new_value, device.spectrum_buffer[i] * 0.95f);
 				}
 			}
+			else {
+				//NOTE: bins 0 .. n / 2 of the r2c output cover 0 .. fft_frequency_max(n), n is the size this frame was computed with.
+				// On a decimated stream that range shrinks by the decimation. Zoomed bins start at zoom_frequency_min, shifting the
+				// range by that maps them like a plain fft of twice their count.
+				FFTPlan& plan = s_fft_plans[spectrum.size_index];
+				f32 zoom_offset = spectrum.zoom_frequency_min;
+				BinMap& map = spectrum.zoomed
+					? get_bin_map(buffer->w, 2 * ZOOM_FFT_SIZE, ZOOM_FFT_SIZE * spectrum.zoom_bin_width, max(s_src_frequency_min - zoom_offset, 0.0f), s_src_frequency_max.current - zoom_offset)
+					: get_bin_map(buffer->w, plan.size, fft_frequency_max(plan.size) / spectrum.decimation, s_src_frequency_min, s_src_frequency_max.current);
+				f64 window_sum = spectrum.zoomed ? s_zoom.window_sum : plan.window_sum;
+				f64* prefix = spectrum.prefix;
+				if(spectrum.scale == SPECTRUM_SCALE_DECIBEL) {
+					//NOTE: columns show the mean of their bins' dB values, the amplification shifts instead of scales
+					f32 range  = s_dynamic_range.current;
+					f32 offset = 20.0f * log10f(s_spectrum_amplification.current) + range;
+					for(u32 i = 0; i < buffer->w; i++) {
+						f32 decibels  = (prefix[map.last_bin[i]] - prefix[map.first_bin[i]]) / (map.last_bin[i] - map.first_bin[i]);
+						f32 new_value = max((decibels + offset) / range, 0.0f);
+						// fade effect
+						device.spectrum_buffer[i] = max(new_value, device.spectrum_buffer[i] * 0.95f);
+					}
+				}
+				else {
+					f32 normalization = s_spectrum_amplification.current / (window_sum * map.bins_per_column);
+					for(u32 i = 0; i < buffer->w; i++) {
+						f32 intensity_f = prefix[map.last_bin[i]] - prefix[map.first_bin[i]];
+						f32 new_value = intensity_f * normalization;
+						// fade effect
+						device.spectrum_buffer[i] = max(new_value, device.spectrum_buffer[i] * 0.95f);
+					}
+				}
+			}
 
 			{
 				for(u32 x = 0; x < buffer->w; x++) {
@@ -222,9 +854,9 @@ void render(RenderBuffer* buffer)
 		{
 			u32 quad_height = buffer->h / 4;
 			u8* upper_pixel_quad = (u8*)buffer->memory + quad_height * 3 * buffer->stride;
-			f32 samples_per_pixel = device.capture_buffer_size / 2.0f / buffer->w;
+			f32 samples_per_pixel = (f32)ring.capacity / buffer->w;
 			for(u32 x = 0; x < buffer->w; x++) {
-				u32 loudness = limit(abs(device.samples_buffer[(u32)(x * samples_per_pixel)]) / s_max_sample_abs.current * quad_height, quad_height);
+				u32 loudness = limit(abs(ring.samples[(u32)(x * samples_per_pixel)]) / s_max_sample_abs.current * quad_height, quad_height);
 				for(u32 y = s_max_sample_values[x]; y < loudness; y++) {
 					((u32*)(upper_pixel_quad + y * buffer->stride))[x] = s_device_colors[d];
 				}
@@ -235,7 +867,7 @@ void render(RenderBuffer* buffer)
 		{
 			u8* line_pixels = (u8*)buffer->memory + (2 + d * 5) * buffer->stride;
 			u32 x = 0;
-			u32 buffer_pos = (f32)device.current_capture_read_progress / device.capture_buffer_size * buffer->w;
+			u32 buffer_pos = (f32)(ring_available(&ring) & (ring.capacity - 1)) / ring.capacity * buffer->w;
 			for(; x < buffer_pos; x++) {
 				((u32*)line_pixels)[x] = s_device_colors[d];
 			}
@@ -259,8 +891,128 @@ void render(RenderBuffer* buffer)
 			}
 		}
 
+		//NOTE: octave bands replace the spectrum with one bar per band and device, from its low to its high edge on the spectrum's
+		// level scale. The topmost device goes last, bands reaching past the displayed range are left out.
+		if(s_show_bands) {
+			for(u32 y = 0; y < quad_height; y++) {
+				u32* row = (u32*)(spectrum_section + y * buffer->stride);
+				for(u32 x = 0; x < buffer->w; x++) row[x] = 0x00ffffff;
+			}
+			for(u32 dd = 1; dd <= s_device_count; dd++) {
+				u32 d = (dd + s_topmost_spectrum) % s_device_count;
+				SpectrumSlot& spectrum = s_spectra[d].slots[s_spectra[d].front];
+				if(spectrum.band_key != s_octave_key) continue;
+				for(u32 i = 0; i < spectrum.band_count; i++) {
+					OctaveBand& band = s_octave_bands[i];
+					i32 left  = frequency_to_column(band.low, buffer->w);
+					i32 right = frequency_to_column(band.high, buffer->w);
+					if(left < 0 || right < 0) continue;
+					u32 height = limit((u32)(level_to_display(16384.0f * powf(10, spectrum.band_levels[i] / 20)) * quad_height), quad_height);
+					for(u32 y = 0; y < height; y++) {
+						u32* row = (u32*)(spectrum_section + y * buffer->stride);
+						for(i32 x = left; x < max(right - 1, left + 1); x++) row[x] = s_device_colors[d];
+					}
+				}
+			}
+		}
+
+		//NOTE: noise floor lines, columns average the floor of their bins like the spectrum does
+		for(u32 d = 0; s_show_noise_floor && d < s_device_count; d++) {
+			SpectrumSlot& spectrum = s_spectra[d].slots[s_spectra[d].front];
+			if(!spectrum.noise_valid || spectrum.zoomed || spectrum.axis != FREQUENCY_AXIS_LINEAR) continue;
+
+			FFTPlan& plan = s_fft_plans[spectrum.size_index];
+			BinMap& map = get_bin_map(buffer->w, plan.size, fft_frequency_max(plan.size) / spectrum.decimation, s_src_frequency_min, s_src_frequency_max.current);
+			f64* prefix = spectrum.noise_prefix;
+			f32 range   = s_dynamic_range.current;
+			f32 offset  = 20.0f * log10f(s_spectrum_amplification.current) + range;
+			f32 normalization = s_spectrum_amplification.current / (plan.window_sum * map.bins_per_column);
+			for(u32 x = 0; x < buffer->w; x++) {
+				f32 sum   = prefix[map.last_bin[x]] - prefix[map.first_bin[x]];
+				f32 value = spectrum.scale == SPECTRUM_SCALE_DECIBEL
+					? max((sum / (map.last_bin[x] - map.first_bin[x]) + offset) / range, 0.0f)
+					: sum * normalization;
+				u32 y = limit((u32)(value * quad_height), quad_height - 1);
+				((u32*)(spectrum_section + y * buffer->stride))[x] = s_device_colors[d] & 0x007f7f7f;
+			}
+		}
+
+		//NOTE: tone markers, a gray line at every tracked frequency and a tick at every device's level on the spectrum's scale
+		u32 tone_generation = s_tone_generation.load(std::memory_order_acquire);
+		ToneConfig& tones = s_tone_configs[tone_generation & 1];
+		for(u32 t = 0; t < tones.tone_count; t++) {
+			i32 x = frequency_to_column(tones.frequencies[t], buffer->w);
+			if(x < 0) continue;
+			for(u32 y = 0; y < quad_height; y += 2) {
+				((u32*)(spectrum_section + y * buffer->stride))[x] = 0x00808080;
+			}
+			for(u32 d = 0; d < s_device_count; d++) {
+				ToneBank& bank = s_tone_banks[d];
+				if(bank.levels_generation.load(std::memory_order_acquire) != tone_generation) continue;
+				f32 value = level_to_display(bank.levels[t].load(std::memory_order_relaxed));
+				u32 y = limit((u32)(value * quad_height), quad_height - 1);
+				for(i32 dx = -3; dx <= 3; dx++) {
+					if(x + dx < 0 || x + dx >= buffer->w) continue;
+					((u32*)(spectrum_section + y * buffer->stride))[x + dx] = s_device_colors[d];
+				}
+			}
+			char label_memory[16] = {};
+			render_text(buffer, x + 4, quad_height * 3 - 16, format(to_s("%d Hz"), to_s(label_memory), (i32)tones.frequencies[t]));
+		}
+
+		//NOTE: peaks, a dot at every device's peaks and frequency labels for the topmost device's
+		for(u32 d = 0; s_show_peaks && d < s_device_count; d++) {
+			SpectrumSlot& spectrum = s_spectra[d].slots[s_spectra[d].front];
+			for(u32 p = 0; p < spectrum.peak_count; p++) {
+				Peak& peak = spectrum.peaks[p];
+				i32 x = frequency_to_column(peak.frequency, buffer->w);
+				if(x < 0) continue;
+				u32 y = limit((u32)(level_to_display(peak.level) * quad_height), quad_height - 3);
+				for(u32 dy = 0; dy < 3; dy++) {
+					for(i32 dx = max(x - 1, 0); dx <= min(x + 1, (i32)buffer->w - 1); dx++) {
+						((u32*)(spectrum_section + (y + dy) * buffer->stride))[dx] = s_device_colors[d];
+					}
+				}
+				if(d != s_topmost_spectrum) continue;
+				char label_memory[24] = {};
+				u32 tenths = (u32)(peak.frequency * 10 + 0.5f);
+				s8 label = format(to_s("%d.%d Hz"), to_s(label_memory), tenths / 10, tenths % 10);
+				render_text(buffer, x + 4, quad_height * 2 + min(y + 6, quad_height - 16), label);
+			}
+		}
+
+		//NOTE: the topmost device's pitch as a line through the spectrum section, confident estimates only
+		SpectrumSlot& topmost = s_spectra[s_topmost_spectrum].slots[s_spectra[s_topmost_spectrum].front];
+		if(s_pitch_method != PITCH_METHOD_OFF && topmost.pitch_count) {
+			PitchEstimate& pitch = topmost.pitch[topmost.pitch_count - 1];
+			i32 x = frequency_to_column(pitch.frequency, buffer->w);
+			if(x >= 0 && pitch.confidence >= 0.5f) {
+				for(u32 y = 0; y < quad_height; y++) {
+					((u32*)(spectrum_section + y * buffer->stride))[x] = 0x00ff00ff;
+				}
+			}
+		}
+
+		//NOTE: the topmost device against the cross analysis reference: coherence from the bottom to the top of the section,
+		// the transfer magnitude from -CROSS_DISPLAY_DB to +CROSS_DISPLAY_DB and a dotted phase from -pi to pi
+		if(s_cross_analysis && topmost.cross_valid && topmost.axis == FREQUENCY_AXIS_LINEAR) {
+			FFTPlan& plan = s_fft_plans[topmost.size_index];
+			BinMap& map = get_bin_map(buffer->w, plan.size, fft_frequency_max(plan.size) / topmost.decimation, s_src_frequency_min, s_src_frequency_max.current);
+			for(u32 x = 0; x < buffer->w; x++) {
+				CrossColumn column = cross_column(topmost, map.first_bin[x], map.last_bin[x]);
+				f32 magnitude = (column.magnitude + CROSS_DISPLAY_DB) / (2 * CROSS_DISPLAY_DB);
+				f32 phase     = (column.phase + (f32)PI) / (2 * (f32)PI);
+				u32 y_coherence = limit((u32)(column.coherence * quad_height), quad_height - 1);
+				u32 y_magnitude = limit((u32)(max(magnitude, 0.0f) * quad_height), quad_height - 1);
+				u32 y_phase     = limit((u32)(phase * quad_height), quad_height - 1);
+				((u32*)(spectrum_section + y_coherence * buffer->stride))[x] = 0x00404040;
+				((u32*)(spectrum_section + y_magnitude * buffer->stride))[x] = 0x00ff8000;
+				if(x & 1) ((u32*)(spectrum_section + y_phase * buffer->stride))[x] = 0x008000ff;
+			}
+		}
+
 		//red block lines
-		u32 slices = (s_samples_per_second * s_buffered_seconds) / s_fft_buckets;
+		u32 slices = s_sample_rings[0].capacity / s_fft_sizes[s_fft_size_index];
 		for(u32 i = 0; i < slices; i++) {
 			u32 x = i * buffer->w / slices;
 			for(u32 y = 0; y < quad_height; y++) {
@@ -268,6 +1020,20 @@ void render(RenderBuffer* buffer)
 			}
 		}
 
+		//NOTE: a momentary loudness bar per device at the right edge of the waveform, -60 to 0 LUFS, with a tick at the true peak hold
+		for(u32 d = 0; s_show_loudness && d < s_device_count; d++) {
+			LoudnessMeter& meter = s_loudness_meters[d];
+			i32 left = (i32)buffer->w - 10 * (s_device_count - d);
+			if(left < 0) continue;
+			u32 level = limit((u32)(max(meter.momentary.load(std::memory_order_relaxed) + 60, 0.0f) / 60 * quad_height), quad_height);
+			u32 peak  = limit((u32)(max(meter.true_peak_max.load(std::memory_order_relaxed) + 60, 0.0f) / 60 * quad_height), quad_height - 1);
+			for(u32 y = 0; y < quad_height; y++) {
+				u32 color = y < level ? s_device_colors[d] : 0x00e0e0e0;
+				if(y == peak) color = 0x00000000;
+				for(i32 x = left; x < left + 8; x++) ((u32*)(upper_pixel_quad + y * buffer->stride))[x] = color;
+			}
+		}
+
 		if(update_waterfall) {
 			static u32 dst_row = 0;
 			for(u32 x = 0; x < buffer->w; x++) {
@@ -289,26 +1055,51 @@ void render(RenderBuffer* buffer)
 		}
 	}
 
-	char b[64]= {};
+	char b[256]= {};
 	s8 text = to_s(b);
 
 	u32 spectrogram_end_height = buffer->h * 3 / 4; 
 	if(s_mouse_pos.x && s_mouse_pos.y && s_mouse_pos.y < spectrogram_end_height) {
 		f32 x_percent = (f32)s_mouse_pos.x / buffer->w;
-		u32 hertz = (s_src_frequency_max.current - s_src_frequency_min) * x_percent;
-		s8 text4 = format(to_s("%d Hz"), text, hertz);
+		s_mouse_frequency = s_src_frequency_min + (s_src_frequency_max.current - s_src_frequency_min) * x_percent;
+		if(s_frequency_axis == FREQUENCY_AXIS_CONSTANT_Q && s_cqt_kernels->bin_count) {
+			s_mouse_frequency = cqt_bin_frequency(s_cqt_kernels, x_percent * (s_cqt_kernels->bin_count - 1));
+		}
+		s8 text4 = format(to_s("%d Hz"), text, (u32)s_mouse_frequency);
 		for(u32 y = buffer->h / 2; y < spectrogram_end_height; y++) {
 			((u32*)((u8*)buffer->memory + y * buffer->stride))[s_mouse_pos.x] = 0x00ff0000;
 		}
 		render_text(buffer, s_mouse_pos.x, buffer->h / 2, text4);
 	}
+	else {
+		s_mouse_frequency = 0;
+	}
 
 	render_text(buffer, 20, buffer->h - 20, to_s(R"x(
 key binds:
 	UP / DOWN : scale input wave form display
 	LEFT / RIGHT : cycle topmost audio source
 	N / M : decrease / increase spectrum width
+	PAGE UP / PAGE DOWN : slide spectrum range
 	COMMA / DOT : scale spectrum width
+	[ / ] : decrease / increase stft hop
+	W : cycle window function
+	- / + : decrease / increase fft size
+	D : toggle linear / dB spectrum
+	E / R : decrease / increase dB range
+	L : toggle linear / constant-Q frequency axis
+	V : toggle multi-resolution spectrum
+	T / Y : track the frequency under the mouse / stop tracking all tones
+	G / H : decrease / increase tone block size
+	A : cycle spectrum averaging
+	F : toggle noise floor
+	P / I : toggle peak labels / cycle peak interpolation
+	K : cycle pitch tracker
+	C / X : toggle cross analysis / cycle its reference device
+	J : toggle delay estimation against the reference device
+	U / Z : toggle loudness meters / restart integrated loudness and peak hold
+	B / O / Q : toggle octave bands / cycle band fraction / cycle band method
+	S : toggle mel / mfcc feature extraction
 )x"));
 	
 	{
@@ -319,6 +1110,114 @@ key binds:
 		render_text(buffer, 20, line_pos += 20, text2);
 		s8 text3 = format(to_s("spectrum amplification: %d%%"), text, (i32)(s_spectrum_amplification.current * 100));
 		render_text(buffer, 20, line_pos += 20, text3);
+		s8 text9 = format(to_s("spectrum scale: %s, dB range: %d dB"), text, s_spectrum_scale_names[s_spectrum_scale], (i32)s_dynamic_range.current);
+		render_text(buffer, 20, line_pos += 20, text9);
+		if(s_analysis_round.multi_resolution) {
+			u32 band_size = s_fft_sizes[multires_band_size_index(s_analysis_round.size_index)];
+			s8 text13 = format(to_s("multi-resolution: %d bands of %d points, finest bins %d mHz"), text,
+				MULTIRES_BAND_COUNT, band_size, (i32)(1000.0f * s_samples_per_second / (band_size << MULTIRES_FINE_SHIFT)));
+			render_text(buffer, 20, line_pos += 20, text13);
+		}
+		if(s_analysis_round.decimation_stages) {
+			u32 stages = s_analysis_round.decimation_stages;
+			s8 text12 = format(to_s("half-band decimation: %d stages, %d point fft at %d Hz"), text,
+				stages, s_fft_sizes[s_analysis_round.size_index] >> stages, s_samples_per_second >> stages);
+			render_text(buffer, 20, line_pos += 20, text12);
+		}
+		if(s_zoom.active) {
+			s8 text11 = format(to_s("zoom fft: decimation %d, %d mHz bins around %dHz"), text,
+				s_zoom.decimation, (i32)(1000.0f * zoom_bin_width(s_samples_per_second)), (i32)s_zoom.center);
+			render_text(buffer, 20, line_pos += 20, text11);
+		}
+		if(s_frequency_axis == FREQUENCY_AXIS_CONSTANT_Q) {
+			s8 text10 = format(to_s("frequency axis: constant-Q, %d bins per octave, %d bins from %dHz"), text,
+				CQT_BINS_PER_OCTAVE, s_cqt_kernels->bin_count, (i32)s_cqt_kernels->frequency_min);
+			render_text(buffer, 20, line_pos += 20, text10);
+		}
+		if(s_psd_averaging != PSD_AVERAGING_OFF || s_show_noise_floor) {
+			s8 text15 = format(to_s("averaging: %s over %d frames, noise floor: %s"), text, s_psd_averaging_names[s_psd_averaging],
+				PSD_AVERAGE_FRAMES, s_show_noise_floor ? "shown" : "hidden");
+			render_text(buffer, 20, line_pos += 20, text15);
+		}
+		if(s_show_peaks) {
+			s8 text16 = format(to_s("peaks: %d on the topmost device, %s interpolation, %d dB above the noise floor"), text,
+				s_spectra[s_topmost_spectrum].slots[s_spectra[s_topmost_spectrum].front].peak_count,
+				s_peak_interpolation_names[s_peak_interpolation], (i32)PEAK_THRESHOLD_DB);
+			render_text(buffer, 20, line_pos += 20, text16);
+		}
+		SpectrumSlot& topmost = s_spectra[s_topmost_spectrum].slots[s_spectra[s_topmost_spectrum].front];
+		if(s_pitch_method != PITCH_METHOD_OFF && topmost.pitch_count) {
+			PitchEstimate& pitch = topmost.pitch[topmost.pitch_count - 1];
+			u32 tenths = (u32)(pitch.frequency * 10 + 0.5f);
+			s8 text17 = format(to_s("pitch (%s): %d.%d Hz, %d%% confidence"), text, s_pitch_method_names[s_pitch_method],
+				tenths / 10, tenths % 10, (i32)(pitch.confidence * 100));
+			render_text(buffer, 20, line_pos += 20, text17);
+		}
+		if(s_cross_analysis) {
+			s8 text18 = topmost.cross_valid
+				? format(to_s("cross: device %d against reference %d, %d frames averaged"), text, s_topmost_spectrum, topmost.cross_reference, topmost.cross_frames)
+				: format(to_s("cross: reference device %d, bring another device to the top"), text, s_cross_reference);
+			render_text(buffer, 20, line_pos += 20, text18);
+		}
+		for(u32 d = 0; s_delay_estimation && d < s_device_count; d++) {
+			SpectrumSlot& spectrum = s_spectra[d].slots[s_spectra[d].front];
+			if(!spectrum.delay_valid) continue;
+			u32 hundredths   = (u32)(fabsf(spectrum.delay) * 100 + 0.5f);
+			u32 microseconds = (u32)(fabsf(spectrum.delay) * 1000000 / s_samples_per_second + 0.5f);
+			s8 text19 = format(to_s("delay: device %d lags reference %d by %s%d.%d%d samples (%s%d us), %d%% confidence"), text,
+				d, spectrum.cross_reference, spectrum.delay < 0 ? "-" : "", hundredths / 100, hundredths / 10 % 10, hundredths % 10,
+				spectrum.delay < 0 ? "-" : "", microseconds, (i32)(spectrum.delay_confidence * 100));
+			render_text(buffer, 20, line_pos += 20, text19);
+		}
+		for(u32 d = 0; s_show_loudness && d < s_device_count; d++) {
+			LoudnessMeter& meter = s_loudness_meters[d];
+			Tenths m = to_tenths(meter.momentary.load(std::memory_order_relaxed));
+			Tenths s = to_tenths(meter.short_term.load(std::memory_order_relaxed));
+			Tenths i = to_tenths(meter.integrated.load(std::memory_order_relaxed));
+			Tenths p = to_tenths(meter.true_peak.load(std::memory_order_relaxed));
+			Tenths h = to_tenths(meter.true_peak_max.load(std::memory_order_relaxed));
+			s8 text20 = format(to_s("loudness %d: M %s%d.%d S %s%d.%d I %s%d.%d LUFS, true peak %s%d.%d dBTP (max %s%d.%d)"), text, d,
+				m.sign, m.whole, m.tenths, s.sign, s.whole, s.tenths, i.sign, i.whole, i.tenths, p.sign, p.whole, p.tenths, h.sign, h.whole, h.tenths);
+			render_text(buffer, 20, line_pos += 20, text20);
+		}
+		if(s_show_bands) {
+			s8 text21 = format(to_s("octave bands: %s octave, %d bands from %d Hz, %s"), text, s_octave_fraction_names[s_octave_fraction],
+				s_octave_band_count, s_octave_band_count ? (i32)s_octave_bands[0].center : 0, s_band_method_names[s_band_method]);
+			render_text(buffer, 20, line_pos += 20, text21);
+		}
+		if(s_extract_features) {
+			u64 frames = s_feature_streams[s_topmost_spectrum].write_count.load(std::memory_order_relaxed);
+			s8 text22 = s_feature_file
+				? format(to_s("features: %d log-mel bands, %d mfcc, %d frames on the topmost device, %d written"), text,
+					MEL_BANDS, MFCC_COEFFICIENTS, (u32)frames, (u32)s_features_written)
+				: format(to_s("features: %d log-mel bands, %d mfcc, %d frames on the topmost device, not written ('-features <file>')"), text,
+					MEL_BANDS, MFCC_COEFFICIENTS, (u32)frames);
+			render_text(buffer, 20, line_pos += 20, text22);
+		}
+		if(s_tone_count) {
+			u32 block = (u32)s_tone_block.current;
+			s8 text14 = format(to_s("tones: %d tracked, %d sample blocks, a level every %d samples"), text, s_tone_count, block, block / TONE_PHASES);
+			render_text(buffer, 20, line_pos += 20, text14);
+		}
+		s8 text5 = format(to_s("stft hop: %d samples, window: %s"), text, (i32)s_stft_hop.current, s_window_function_names[s_window_function]);
+		render_text(buffer, 20, line_pos += 20, text5);
+		u32 fft_size = s_fft_sizes[s_fft_size_index];
+		s8 text6 = format(to_s("fft size: %d, resolution: %d mHz"), text, fft_size, (i32)(1000.0f * s_samples_per_second / fft_size));
+		render_text(buffer, 20, line_pos += 20, text6);
+		render_text(buffer, 20, line_pos += 20, format_fft_planning_report(text));
+		s8 text7 = format(to_s("simd: %s, fft jobs: %d batched / %d per device, %d workers, %d us per round"), text, s_simd_level_names[s_simd_level],
+			s_batched_executions, s_single_executions, s_work_queue.worker_count, (i32)(s_round_work_seconds * 1000000));
+		render_text(buffer, 20, line_pos += 20, text7);
+		u64 dropped_samples = 0;
+		for(u32 d = 0; d < MAX_CAPTURE_DEVICES; d++) dropped_samples += s_sample_rings[d].dropped_count.load(std::memory_order_relaxed);
+		u64 computed = 0, skipped = 0, coalesced = 0;
+		for(u32 d = 0; d < MAX_CAPTURE_DEVICES; d++) {
+			computed  += s_stft_states[d].frames_computed;
+			skipped   += s_stft_states[d].frames_skipped;
+			coalesced += s_stft_states[d].frames_coalesced;
+		}
+		s8 text8 = format(to_s("dropped samples: %d, frames: %d computed / %d skipped / %d coalesced"), text, (i32)dropped_samples, (i32)computed, (i32)skipped, (i32)coalesced);
+		render_text(buffer, 20, line_pos += 20, text8);
 	}
 }
 
@@ -336,15 +1235,8 @@ BOOL CALLBACK DSEnumCallback(LPGUID guid, LPCTSTR description, LPCTSTR driver_na
 		return true;
 	}
 	Win32CaptureDevice& device = s_capture_devices[s_device_count];
-	FFTWData& fftw = s_fftw_buffers[s_device_count];
-
 	s_device_count++;
 
-	fftw.in   = (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * s_fft_buckets);
-	fftw.out  = (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * s_fft_buckets);
-	fftw.plan = fftw_plan_dft_1d(s_fft_buckets, fftw.in, fftw.out, FFTW_FORWARD, FFTW_ESTIMATE);
-	memset(fftw.in, 0, sizeof(fftw_complex) * s_fft_buckets);
-
 	LPDIRECTSOUNDCAPTURE capture_interface;
 	if(FAILED(DirectSoundCaptureCreate(guid, &capture_interface, 0))) {
 		exit(4);
@@ -386,24 +1278,64 @@ BOOL CALLBACK DSEnumCallback(LPGUID guid, LPCTSTR description, LPCTSTR driver_na
 	device.capture_buffer->GetCaps(&buffer_caps);
 	device.capture_buffer_size = buffer_caps.dwBufferBytes;
 
-	device.samples_buffer = (i16*)r_allocate(buffer_caps.dwBufferBytes);
+	ring_init(&s_sample_rings[s_device_count - 1], s_samples_per_second * s_buffered_seconds);
 
 	device.capture_buffer->Start(DSCBSTART_LOOPING);
 
 	return s_device_count < MAX_CAPTURE_DEVICES; // false = stop enumeration
 }
 
-void init()
+void init(char* command_line)
 {
+	init_simd();
+	parse_fft_options(command_line);
+	parse_tone_options(command_line);
+	parse_feature_options(command_line);
+	load_fft_wisdom();
+
 	s_device_count = -1;
 	if(FAILED(DirectSoundCaptureEnumerate(DSEnumCallback, 0))) {
 		exit(3);
 	}
+
+	create_fft_plans(max(s_device_count, 0));
+	create_zoom_plan(s_zoom_states, max(s_device_count, 0));
+	allocate_tone_configs();
+	init_loudness(s_samples_per_second);
+	for(u32 d = 0; d < s_device_count; d++) reset_loudness_meter(&s_loudness_meters[d], 0);
+	create_pitch_plans(s_pitch_states, max(s_device_count, 0));
+	create_delay_plans(s_delay_states, max(s_device_count, 0));
+	create_mfcc_plan(s_mfcc_states, max(s_device_count, 0));
+	init_halfband_taps();
+	for(u32 d = 0; d < s_device_count; d++) allocate_decimator(&s_decimators[d]);
+	for(u32 d = 0; d < s_device_count; d++) allocate_multires_state(&s_multires[d]);
+	for(u32 d = 0; d < s_device_count; d++) allocate_cross_spectrum(&s_cross_spectra[d]);
+	for(u32 d = 0; d < s_device_count; d++) allocate_psd_state(&s_psd_states[d]);
+	for(u32 d = 0; d < s_device_count; d++) allocate_spectrum_buffers(&s_spectra[d]);
+	for(u32 d = 0; d < s_device_count; d++) allocate_feature_stream(&s_feature_streams[d]);
+	start_workers(&s_work_queue);
+	start_cqt_build_thread();
+
+	s_capture_running.store(true);
+	s_capture_thread = start_thread(capture_thread, 0);
+
+	save_fft_wisdom();
+
+	char b[128] = {};
+	format_fft_planning_report(to_s(b));
+	OutputDebugString(b);
+	OutputDebugString("\n");
 }
 
 void deinit()
 {
+	s_capture_running.store(false);
+	join_thread(s_capture_thread);
+
 	for(u32 i = 0; i < MAX_CAPTURE_DEVICES; i++)
 		if(s_capture_devices[i].capture_buffer)
 			s_capture_devices[i].capture_buffer->Stop();
+
+	drain_feature_streams(s_feature_streams, s_fft_batch.device_count);
+	if(s_feature_file) close_file(s_feature_file);
 }
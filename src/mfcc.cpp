@@ -0,0 +1,228 @@
+#pragma once
+#include <atomic>
+#include <math.h>
+#include "basetypes.h"
+#include "platform.h"
+#include "fft.cpp"
+#include "simd.cpp"
+
+///////////////////////////////////////////////////////////
+//                   Mel / MFCC Features                 //
+///////////////////////////////////////////////////////////
+
+//NOTE: log-mel and mfcc frames for a downstream classifier, computed from the magnitudes every frame of a round transforms
+// anyway, so there is one feature frame per device and hop.
+//  log-mel - MEL_BANDS triangular filters on the htk mel scale from MEL_FREQUENCY_MIN to MEL_FREQUENCY_MAX with unit peaks,
+//            applied to the frame's power as the mean square it stands for (like fft_band_levels), in natural log relative to
+//            a full scale sine, so a full scale sine on a filter's center reads 0. Filters are sparse: only the bins under a
+//            triangle get stored, every bin ends up in at most two of them.
+//  mfcc    - the orthonormal dct-ii of the log-mel frame, an fftw REDFT10 plan with its scale applied afterwards. The plan is
+//            created at startup on the first device's buffers and runs on every device's with fftwf_execute_r2r.
+// Frames go into a ring of FeatureFrames per device, single producer (whichever worker transforms the device) and any number
+// of readers that keep their own cursor. Readers never hold up the analysis, a reader that falls more than
+// FEATURE_RING_CAPACITY frames behind loses the oldest ones. '-features <file>' writes every device's frames to that file
+// as raw FeatureFrames in the order they get drained.
+// Filters above the rate a round runs at stay empty and read MEL_POWER_FLOOR, the layout itself never changes with the
+// display settings.
+global const u32 MEL_BANDS             = 40;
+global const u32 MFCC_COEFFICIENTS     = 13;
+global const f32 MEL_FREQUENCY_MIN     = 20.0f;
+global const f32 MEL_FREQUENCY_MAX     = 8000.0f;
+global const f32 MEL_POWER_FLOOR       = 1e-10f; // -100 dB re full scale, keeps silent bands finite
+global const u32 MEL_WEIGHT_CAPACITY   = 2 * (MAX_FFT_SIZE / 2 + 1);
+global const u32 FEATURE_RING_CAPACITY = 1024; // frames, power of two
+
+// the layout of the stream and of the '-features' file, 232 bytes without padding
+struct FeatureFrame {
+	u64 frame_end;   // sample count of the device's stream the frame ended at
+	u32 device;
+	u32 sample_rate; // of the device's stream, frames of decimated rounds still count full rate samples
+	f32 energy;      // natural log of the whole frame's mean square relative to a full scale sine
+	f32 log_mel[MEL_BANDS];
+	f32 mfcc[MFCC_COEFFICIENTS];
+};
+
+struct FeatureStream {
+	FeatureFrame*    frames;
+	std::atomic<u64> write_count;
+	u64              file_cursor; // the '-features' file's reader, ui thread
+};
+
+struct MfccState {
+	f32* power;    // squared magnitudes up to the last mel filter's bins
+	f32* log_mel;
+	f32* cepstrum;
+};
+
+struct MelFilter {
+	u32 first_bin;
+	u32 bin_count;
+	u32 offset;    // into s_mel_weight_pool
+};
+
+global bool       s_extract_features;
+global void*      s_feature_file;
+global u64        s_features_written;
+global fftwf_plan s_mfcc_plan;
+global MelFilter  s_mel_filters[MEL_BANDS];
+global f32*       s_mel_weight_pool;
+global f32        s_mel_bin_width;
+global u32        s_mel_bin_count;
+global u32        s_mel_bin_end;   // past the last bin any filter covers
+
+f32 frequency_to_mel(f32 frequency)
+{
+	return 2595.0f * log10f(1 + frequency / 700.0f);
+}
+
+f32 mel_to_frequency(f32 mel)
+{
+	return 700.0f * (powf(10, mel / 2595.0f) - 1);
+}
+
+// reads '-features <file>', starts extracting right away when given
+void parse_feature_options(char* command_line)
+{
+	char* path = strstr(command_line, "-features ");
+	if(!path) return;
+	path += sizeof("-features ") - 1;
+
+	char file_name[MAX_PATH] = {};
+	u32 length = 0;
+	while(path[length] && path[length] != ' ' && length < MAX_PATH - 1) length++;
+	memcpy(file_name, path, length);
+
+	s_feature_file = open_output_file(file_name);
+	if(s_feature_file) s_extract_features = true;
+	else OutputDebugString("failed to open the feature file\n");
+}
+
+void create_mfcc_plan(MfccState* states, u32 device_count)
+{
+	for(u32 d = 0; d < device_count; d++) {
+		states[d].power    = (f32*)r_allocate((MAX_FFT_SIZE / 2 + 1) * sizeof(f32));
+		states[d].log_mel  = fftwf_alloc_real(MEL_BANDS);
+		states[d].cepstrum = fftwf_alloc_real(MEL_BANDS);
+	}
+	if(!device_count) return;
+
+	f64 start = get_seconds();
+	s_mfcc_plan = fftwf_plan_r2r_1d(MEL_BANDS, states[0].log_mel, states[0].cepstrum, FFTW_REDFT10, s_plan_quality_flags[s_plan_quality]);
+	s_plan_report.plans_created++;
+	s_plan_report.planning_seconds += get_seconds() - start;
+}
+
+void allocate_feature_stream(FeatureStream* stream)
+{
+	stream->frames = (FeatureFrame*)r_allocate(FEATURE_RING_CAPACITY * sizeof(FeatureFrame));
+	stream->write_count.store(0);
+	stream->file_cursor = 0;
+}
+
+//NOTE: ui thread, between rounds. Triangle m rises from the center of m - 1 to its own and falls to the center of m + 1,
+// the centers are evenly spaced in mel. Bin k sits at k bin widths.
+void update_mel_filters(f32 bin_width, u32 bin_count)
+{
+	if(s_mel_bin_width == bin_width && s_mel_bin_count == bin_count) return;
+	s_mel_bin_width = bin_width;
+	s_mel_bin_count = bin_count;
+	if(!s_mel_weight_pool) s_mel_weight_pool = (f32*)r_allocate(MEL_WEIGHT_CAPACITY * sizeof(f32));
+
+	f32 mel_min = frequency_to_mel(MEL_FREQUENCY_MIN);
+	f32 mel_step = (frequency_to_mel(MEL_FREQUENCY_MAX) - mel_min) / (MEL_BANDS + 1);
+	u32 offset = 0;
+	for(u32 m = 0; m < MEL_BANDS; m++) {
+		f32 low    = mel_to_frequency(mel_min + m * mel_step) / bin_width;
+		f32 center = mel_to_frequency(mel_min + (m + 1) * mel_step) / bin_width;
+		f32 high   = mel_to_frequency(mel_min + (m + 2) * mel_step) / bin_width;
+		u32 first = (u32)ceilf(low);
+		u32 last  = min((u32)ceilf(high), bin_count); // exclusive
+
+		MelFilter& filter = s_mel_filters[m];
+		filter.first_bin = first;
+		filter.bin_count = last > first ? last - first : 0;
+		filter.offset    = offset;
+		for(u32 k = first; k < last; k++) {
+			s_mel_weight_pool[offset++] = k < center ? (k - low) / (center - low) : (high - k) / (high - center);
+		}
+		s_mel_bin_end = last;
+	}
+}
+
+//NOTE: worker, right after a frame's magnitudes were computed. `magnitudes` of a frame transformed with `plan` like
+// fft_band_levels, `frame_end` in full rate samples.
+void extract_features(MfccState* state, FeatureStream* stream, const f32* magnitudes, FFTPlan& plan, u64 frame_end, u32 device,
+	u32 sample_rate)
+{
+	u64 index = stream->write_count.load(std::memory_order_relaxed);
+	FeatureFrame& frame = stream->frames[index & (FEATURE_RING_CAPACITY - 1)];
+
+	// a full scale sine's mean square is 1
+	f32 scale = (f32)(2.0 / (plan.size * plan.window_power) / (32768.0 * 32768.0 / 2));
+	frame.energy = logf(max(dot_product_f32(magnitudes, magnitudes, plan.size / 2 + 1) * scale, MEL_POWER_FLOOR));
+
+	// squared once so every filter is a dot product of its weights with the bins under it
+	for(u32 k = 0; k < s_mel_bin_end; k++) state->power[k] = magnitudes[k] * magnitudes[k];
+	for(u32 m = 0; m < MEL_BANDS; m++) {
+		MelFilter& filter = s_mel_filters[m];
+		f32 power = dot_product_f32(s_mel_weight_pool + filter.offset, state->power + filter.first_bin, filter.bin_count);
+		state->log_mel[m] = logf(max(power * scale, MEL_POWER_FLOOR));
+	}
+	fftwf_execute_r2r(s_mfcc_plan, state->log_mel, state->cepstrum);
+
+	// REDFT10 is 2 * the unnormalized dct-ii
+	f32 scale_first = sqrtf(1.0f / (4 * MEL_BANDS));
+	f32 scale_rest  = sqrtf(1.0f / (2 * MEL_BANDS));
+	for(u32 c = 0; c < MFCC_COEFFICIENTS; c++) frame.mfcc[c] = state->cepstrum[c] * (c ? scale_rest : scale_first);
+	memcpy(frame.log_mel, state->log_mel, sizeof(frame.log_mel));
+	frame.frame_end   = frame_end;
+	frame.device      = device;
+	frame.sample_rate = sample_rate;
+
+	stream->write_count.store(index + 1, std::memory_order_release);
+}
+
+//NOTE: copies up to `max_count` frames after `*cursor` and advances it. A cursor that fell behind skips to the oldest frame still
+// in the ring, frames the producer might have overwritten while they were copied get dropped. Returns the frames that made it,
+// which can be 0 while the cursor still moved.
+u32 read_features(FeatureStream* stream, u64* cursor, FeatureFrame* dst, u32 max_count)
+{
+	u64 write_count = stream->write_count.load(std::memory_order_acquire);
+	if(write_count > FEATURE_RING_CAPACITY) *cursor = max(*cursor, write_count - FEATURE_RING_CAPACITY);
+	u32 count = (u32)min(write_count - *cursor, (u64)max_count);
+	for(u32 i = 0; i < count; i++) dst[i] = stream->frames[(*cursor + i) & (FEATURE_RING_CAPACITY - 1)];
+
+	// the producer is at most one frame into overwriting the slot after write_count, the fence keeps the copies above this load
+	std::atomic_thread_fence(std::memory_order_acquire);
+	u64 overwritten = stream->write_count.load(std::memory_order_relaxed) + 1;
+	u32 valid = count;
+	if(overwritten > FEATURE_RING_CAPACITY) {
+		u64 oldest = overwritten - FEATURE_RING_CAPACITY;
+		u32 lost = oldest > *cursor ? (u32)min(oldest - *cursor, (u64)count) : 0;
+		memmove(dst, dst + lost, (count - lost) * sizeof(FeatureFrame));
+		valid = count - lost;
+	}
+	*cursor += count;
+	return valid;
+}
+
+// ui thread, hands everything new to the '-features' file
+void drain_feature_streams(FeatureStream* streams, u32 device_count)
+{
+	if(!s_feature_file) return;
+
+	FeatureFrame frames[64];
+	for(u32 d = 0; d < device_count; d++) {
+		FeatureStream& stream = streams[d];
+		while(stream.file_cursor < stream.write_count.load(std::memory_order_acquire)) {
+			u32 count = read_features(&stream, &stream.file_cursor, frames, 64);
+			if(count && !write_file(s_feature_file, frames, count * sizeof(FeatureFrame))) {
+				OutputDebugString("failed to write features, closing the feature file\n");
+				close_file(s_feature_file);
+				s_feature_file = 0;
+				return;
+			}
+			s_features_written += count;
+		}
+	}
+}
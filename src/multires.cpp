@@ -0,0 +1,104 @@
+#pragma once
+#include "basetypes.h"
+#include "platform.h"
+#include "stft.cpp"
+#include "fft.cpp"
+#include "simd.cpp"
+#include "sample_ring.cpp"
+#include "decimate.cpp"
+
+///////////////////////////////////////////////////////////
+//               Multi-resolution Spectrum               //
+///////////////////////////////////////////////////////////
+
+//NOTE: every band runs the same small fft on the stream decimated by 2^stages, so lower bands get finer bins and longer frames.
+// Each band hops a quarter of its own frame, the full rate band updates every round while the lowest one only every
+// 2^MULTIRES_FINE_SHIFT rounds. The bands get stitched into one spectrum on the grid of the finest band, coarser bins get
+// repeated, so it renders like a plain fft 2^MULTIRES_FINE_SHIFT times the band size.
+global const u32 MULTIRES_BAND_COUNT   = 3;
+global const u32 s_multires_stages[MULTIRES_BAND_COUNT] = { 0, 2, 4 };
+global const u32 MULTIRES_FINE_SHIFT   = 4; // stages of the lowest band
+global const u32 MULTIRES_OVERLAP      = 4;
+global const u32 MULTIRES_MAX_BAND_SIZE = MAX_FFT_SIZE >> MULTIRES_FINE_SHIFT; // the lowest band's frame has to fit the ring history
+
+struct MultiresState {
+	StftState      bands[MULTIRES_BAND_COUNT];
+	DecimatorState decimators[MULTIRES_BAND_COUNT]; // unused for the full rate band
+	f32*           magnitudes[MULTIRES_BAND_COUNT];  // newest spectrum of every band
+};
+
+void allocate_multires_state(MultiresState* state)
+{
+	for(u32 b = 0; b < MULTIRES_BAND_COUNT; b++) {
+		if(s_multires_stages[b]) allocate_decimator(&state->decimators[b]);
+		state->magnitudes[b] = (f32*)r_allocate((MULTIRES_MAX_BAND_SIZE / 2 + 1) * sizeof(f32));
+	}
+}
+
+// index into s_fft_sizes of the size every band transforms with, an eighth of the selected size within the limits
+u32 multires_band_size_index(u32 size_index)
+{
+	u32 index = size_index >= 3 ? size_index - 3 : 0;
+	while(s_fft_sizes[index] > MULTIRES_MAX_BAND_SIZE) index--;
+	return index;
+}
+
+// the stitched spectrum has the bins of an fft this much larger than the band size
+u32 multires_stitched_size_index(u32 size_index)
+{
+	return multires_band_size_index(size_index) + MULTIRES_FINE_SHIFT;
+}
+
+// hop of the full rate band, rounds run at this hop so that band updates with every one
+u32 multires_hop(u32 size_index)
+{
+	return s_fft_sizes[multires_band_size_index(size_index)] / MULTIRES_OVERLAP;
+}
+
+// highest frequency a band is used for as a bin index of the stitched spectrum, the full rate band covers everything above the others
+u32 multires_band_limit(u32 band, u32 band_size)
+{
+	if(band == 0) return (band_size << MULTIRES_FINE_SHIFT) / 2;
+	return (u32)(HALFBAND_PASSBAND * ((band_size << MULTIRES_FINE_SHIFT) / 2 >> s_multires_stages[band]));
+}
+
+//NOTE: transforms the newest due frame of every band of one device, frames of a band that became due in the same round are
+// coalesced since only the newest one gets displayed. Bands without a due frame keep their previous spectrum.
+// `stitched` gets the bins of the plan at multires_stitched_size_index, scaled to its window.
+void analyze_multires(MultiresState* state, u32 device, SampleRing* ring, u64 samples_available, u32 size_index, f32* stitched)
+{
+	FFTPlan& plan = s_fft_plans[multires_band_size_index(size_index)];
+	f32* in = fft_input(device, plan.size);
+	fftwf_complex* out = fft_output(device, plan.size);
+
+	for(u32 b = 0; b < MULTIRES_BAND_COUNT; b++) {
+		StftState& band = state->bands[b];
+		u32 stages = s_multires_stages[b];
+		u32 frames = schedule_frames(&band, samples_available, plan.size << stages, (plan.size << stages) / MULTIRES_OVERLAP);
+		if(!frames) continue;
+
+		u64 end = frame_end(&band, frames - 1);
+		if(stages) {
+			u64 first_end = frame_end(&band, 0);
+			decimate_until(&state->decimators[b], ring, stages, end, first_end - min(first_end, (u64)MAX_FFT_SIZE));
+			gather_decimated(&state->decimators[b], end, plan.window, in, plan.size);
+		}
+		else {
+			RingSpan span = ring_span(ring, end - plan.size, plan.size);
+			convert_i16_to_f32_windowed(span.first, plan.window, in, span.first_length);
+			convert_i16_to_f32_windowed(span.second, plan.window + span.first_length, in + span.first_length, span.second_length);
+		}
+		fftwf_execute_dft_r2c(plan.plan, in, out);
+		compute_magnitudes((f32*)out, state->magnitudes[b], plan.size / 2 + 1);
+	}
+
+	// lowest band first, every band fills the bins from where the one below it stopped
+	f32 scale = s_fft_plans[multires_stitched_size_index(size_index)].window_sum / plan.window_sum;
+	u32 bin = 0;
+	for(u32 b = MULTIRES_BAND_COUNT; b-- > 0;) {
+		u32 shift = MULTIRES_FINE_SHIFT - s_multires_stages[b];
+		u32 limit = multires_band_limit(b, plan.size);
+		f32* magnitudes = state->magnitudes[b];
+		for(; bin <= limit; bin++) stitched[bin] = magnitudes[bin >> shift] * scale;
+	}
+}
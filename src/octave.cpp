@@ -0,0 +1,297 @@
+#pragma once
+#include <math.h>
+#include "basetypes.h"
+#include "platform.h"
+#include "fft.cpp"
+#include "sample_ring.cpp"
+#include "decimate.cpp"
+
+///////////////////////////////////////////////////////////
+//                  Fractional Octave Bands              //
+///////////////////////////////////////////////////////////
+
+//NOTE: levels of the iec 61260 base 10 octave bands, from 20 Hz to 20 kHz nominal, in dB relative to a full scale sine. Two ways
+// to get them:
+//  fft         - the power of the bins a band covers, bins straddling an edge count with the part of their width inside it.
+//                The weight tables get built once per band layout and bin width, a band update is then one multiply add per bin.
+//  filter bank - a 6th order butterworth band pass (3 biquads) per band on the sample stream. Every band runs at the lowest rate
+//                of the half-band cascade that still keeps it in the passband, so each octave down costs half of the one
+//                above and the whole bank about twice its top octave. The mean square gets time weighted with
+//                BAND_TIME_CONSTANT like the "fast" setting of a sound level meter.
+// The bank's layout only changes between rounds (update_octave_bands on the ui thread), workers just read it.
+enum OctaveFraction : u32 {
+	OCTAVE_FRACTION_FULL,
+	OCTAVE_FRACTION_THIRD,
+	OCTAVE_FRACTION_TWELFTH,
+
+	OCTAVE_FRACTION_COUNT,
+};
+
+global const char* s_octave_fraction_names[OCTAVE_FRACTION_COUNT] = { "1/1", "1/3", "1/12" };
+global const u32   s_bands_per_octave[OCTAVE_FRACTION_COUNT]      = { 1, 3, 12 };
+
+enum BandMethod : u32 {
+	BAND_METHOD_FFT,
+	BAND_METHOD_FILTER_BANK,
+
+	BAND_METHOD_COUNT,
+};
+
+global const char* s_band_method_names[BAND_METHOD_COUNT] = { "fft bin weights", "filter bank" };
+
+global const f32 BAND_CENTER_MIN      = 19.0f;    // the 20 Hz band's exact center is 19.95 Hz
+global const f32 BAND_CENTER_MAX      = 20500.0f;
+global const u32 BAND_SECTIONS        = 3;
+global const u32 MAX_BAND_LEVELS      = 8;        // full rate and up to 7 halvings
+global const f64 BAND_TIME_CONSTANT   = 0.125;
+global const f32 BAND_SILENCE         = -120.0f;
+global const u32 BAND_WEIGHT_CAPACITY = MAX_FFT_SIZE / 2 + 1 + 2 * MAX_BANDS; // every bin once plus the shared edge bins
+
+struct OctaveBand {
+	f32 center;
+	f32 low;
+	f32 high;
+	u32 level;                             // the band gets filtered at the sample rate >> level
+	f32 coefficients[BAND_SECTIONS][5];    // b0, b1, b2, a1, a2 at that rate
+};
+
+struct BandWeights {
+	u32 first_bin;
+	u32 bin_count;
+	u32 offset;    // into s_band_weight_pool
+};
+
+struct FilterBankState {
+	u32           key;      // octave_key of the layout the state belongs to
+	u64           position; // next input sample
+	HalfbandStage halfbands[MAX_BAND_LEVELS - 1];
+	f32           state[MAX_BANDS][BAND_SECTIONS][2];
+	f64           energy[MAX_BANDS];       // of the current round
+	u32           samples[MAX_BAND_LEVELS]; // per level in the current round
+	f64           mean_square[MAX_BANDS];  // time weighted
+	bool          weighted;                // mean_square holds something
+};
+
+global bool           s_show_bands;
+global OctaveFraction s_octave_fraction = OCTAVE_FRACTION_THIRD;
+global BandMethod     s_band_method     = BAND_METHOD_FFT;
+
+global OctaveBand  s_octave_bands[MAX_BANDS];
+global u32         s_octave_band_count;
+global u32         s_octave_key = ~0u;
+global u32         s_band_levels[MAX_BAND_LEVELS][2]; // first and end band of every level, bands are sorted by frequency
+global u32         s_band_level_count;
+global BandWeights s_band_weights[MAX_BANDS];
+global f32*        s_band_weight_pool;
+global f32         s_band_weight_bin_width;
+global u32         s_band_weight_bin_count;
+global u32         s_band_weight_key = ~0u;
+
+u32 octave_key(OctaveFraction fraction, u32 sample_rate)
+{
+	return fraction | sample_rate << 4;
+}
+
+// full scale sine mean square to dB, a full scale sine in a band reads 0
+f32 band_level(f64 mean_square)
+{
+	if(mean_square <= 0) return BAND_SILENCE;
+	return max(10 * (f32)log10(mean_square / (32768.0 * 32768.0 / 2)), BAND_SILENCE);
+}
+
+//NOTE: butterworth band pass from the 3rd order low pass prototype, s -> (s^2 + w0^2) / (s B), with prewarped edges and the
+// bilinear transform. Every prototype pole p turns into the two roots of s^2 - p B s + w0^2, the ones with a positive imaginary
+// part and their conjugates make up the sections. All zeros sit at dc and nyquist, each section gets unity gain at the center.
+void design_band_filter(OctaveBand* band, f64 sample_rate)
+{
+	f64 low  = 2 * sample_rate * tan(PI * band->low / sample_rate);
+	f64 high = 2 * sample_rate * tan(PI * band->high / sample_rate);
+	f64 w0   = sqrt(low * high);
+	f64 bandwidth = high - low;
+	f64 center = 2 * atan(w0 / (2 * sample_rate));
+
+	u32 section = 0;
+	for(u32 k = 0; k < BAND_SECTIONS; k++) {
+		f64 angle = PI * (2 * k + BAND_SECTIONS + 1) / (2 * BAND_SECTIONS);
+		f64 p_re = cos(angle) * bandwidth, p_im = sin(angle) * bandwidth;
+
+		// principal square root of (p B)^2 - 4 w0^2
+		f64 d_re = p_re * p_re - p_im * p_im - 4 * w0 * w0;
+		f64 d_im = 2 * p_re * p_im;
+		f64 d_abs = sqrt(d_re * d_re + d_im * d_im);
+		f64 r_re = sqrt((d_abs + d_re) / 2);
+		f64 r_im = copysign(sqrt(max(d_abs - d_re, 0.0) / 2), d_im);
+
+		for(i32 sign = 1; sign >= -1; sign -= 2) {
+			f64 s_re = (p_re + sign * r_re) / 2 / (2 * sample_rate);
+			f64 s_im = (p_im + sign * r_im) / 2 / (2 * sample_rate);
+			if(s_im <= 0 || section == BAND_SECTIONS) continue;
+
+			// z = (1 + s) / (1 - s) with s already divided by 2 fs
+			f64 denominator = (1 - s_re) * (1 - s_re) + s_im * s_im;
+			f64 z_re = ((1 + s_re) * (1 - s_re) - s_im * s_im) / denominator;
+			f64 z_im = ((1 + s_re) * s_im + s_im * (1 - s_re)) / denominator;
+			f64 a1 = -2 * z_re;
+			f64 a2 = z_re * z_re + z_im * z_im;
+
+			// |1 - e^-2iw| / |1 + a1 e^-iw + a2 e^-2iw| at the center
+			f64 n_re = 1 - cos(2 * center), n_im = sin(2 * center);
+			f64 e_re = 1 + a1 * cos(center) + a2 * cos(2 * center), e_im = -a1 * sin(center) - a2 * sin(2 * center);
+			f64 gain = sqrt((e_re * e_re + e_im * e_im) / (n_re * n_re + n_im * n_im));
+
+			f32* c = band->coefficients[section++];
+			c[0] = (f32)gain;
+			c[1] = 0;
+			c[2] = (f32)-gain;
+			c[3] = (f32)a1;
+			c[4] = (f32)a2;
+		}
+	}
+}
+
+// ui thread, between rounds
+void update_octave_bands(OctaveFraction fraction, u32 sample_rate)
+{
+	u32 key = octave_key(fraction, sample_rate);
+	if(s_octave_key == key) return;
+	s_octave_key = key;
+
+	// base 10 midbands 1000 * G^(x / b), shifted by half a band for an even number of bands per octave
+	f64 g = pow(10.0, 0.3);
+	u32 b = s_bands_per_octave[fraction];
+	f64 shift = b % 2 ? 0 : 0.5;
+	u32 count = 0;
+	for(i32 x = -7 * (i32)b; x <= 5 * (i32)b && count < MAX_BANDS; x++) {
+		f64 center = 1000 * pow(g, (x + shift) / b);
+		f64 low    = center * pow(g, -0.5 / b);
+		f64 high   = center * pow(g, 0.5 / b);
+		if(center < BAND_CENTER_MIN || center > BAND_CENTER_MAX || high >= sample_rate / 2) continue;
+
+		OctaveBand& band = s_octave_bands[count++];
+		band.center = (f32)center;
+		band.low    = (f32)low;
+		band.high   = (f32)high;
+		band.level  = 0;
+		while(band.level + 1 < MAX_BAND_LEVELS && high <= HALFBAND_PASSBAND * sample_rate / (2 << (band.level + 1))) band.level++;
+		design_band_filter(&band, (f64)(sample_rate >> band.level));
+	}
+	s_octave_band_count = count;
+
+	// levels only go down with frequency, so every level is one run of bands
+	s_band_level_count = count ? s_octave_bands[0].level + 1 : 0;
+	for(u32 l = 0; l < MAX_BAND_LEVELS; l++) s_band_levels[l][0] = s_band_levels[l][1] = 0;
+	for(u32 i = count; i-- > 0;) {
+		u32 level = s_octave_bands[i].level;
+		s_band_levels[level][0] = i;
+		if(!s_band_levels[level][1]) s_band_levels[level][1] = i + 1;
+	}
+}
+
+// ui thread, between rounds. Bin k covers (k - 1/2) to (k + 1/2) bin widths.
+void update_band_weights(f32 bin_width, u32 bin_count)
+{
+	if(s_band_weight_key == s_octave_key && s_band_weight_bin_width == bin_width && s_band_weight_bin_count == bin_count) return;
+	s_band_weight_key       = s_octave_key;
+	s_band_weight_bin_width = bin_width;
+	s_band_weight_bin_count = bin_count;
+	if(!s_band_weight_pool) s_band_weight_pool = (f32*)r_allocate(BAND_WEIGHT_CAPACITY * sizeof(f32));
+
+	u32 offset = 0;
+	for(u32 i = 0; i < s_octave_band_count; i++) {
+		OctaveBand& band = s_octave_bands[i];
+		f32 low  = band.low / bin_width;
+		f32 high = band.high / bin_width;
+		u32 first = (u32)max(low + 0.5f, 0.0f);
+		u32 last  = min((u32)(high + 0.5f), bin_count - 1);
+
+		BandWeights& weights = s_band_weights[i];
+		weights.first_bin = first;
+		weights.bin_count = last >= first ? last - first + 1 : 0;
+		weights.offset    = offset;
+		for(u32 k = first; k <= last; k++) {
+			f32 overlap = min(high, k + 0.5f) - max(low, k - 0.5f);
+			s_band_weight_pool[offset++] = max(overlap, 0.0f);
+		}
+	}
+}
+
+//NOTE: `magnitudes` of a frame transformed with `plan`. A sine of amplitude A leaves N A^2 / 4 * window_power in its bins, so
+// twice the band's power over N * window_power is the mean square it stands for.
+void fft_band_levels(const f32* magnitudes, FFTPlan& plan, f32* levels)
+{
+	f64 scale = 2.0 / (plan.size * plan.window_power);
+	for(u32 i = 0; i < s_octave_band_count; i++) {
+		BandWeights& weights = s_band_weights[i];
+		const f32* m = magnitudes + weights.first_bin;
+		const f32* w = s_band_weight_pool + weights.offset;
+		f32 power = 0;
+		for(u32 k = 0; k < weights.bin_count; k++) power += w[k] * m[k] * m[k];
+		levels[i] = band_level(power * scale);
+	}
+}
+
+void reset_filter_bank(FilterBankState* state, u32 key, u64 position)
+{
+	memset(state, 0, sizeof(FilterBankState));
+	state->key      = key;
+	state->position = position;
+}
+
+// all bands of one level, one sample at that level's rate
+void run_band_level(FilterBankState* state, u32 level, f32 input)
+{
+	state->samples[level]++;
+	for(u32 i = s_band_levels[level][0]; i < s_band_levels[level][1]; i++) {
+		f32 x = input;
+		for(u32 s = 0; s < BAND_SECTIONS; s++) {
+			const f32* c = s_octave_bands[i].coefficients[s];
+			f32* z = state->state[i][s];
+			f32 y = c[0] * x + z[0];
+			z[0] = c[1] * x - c[3] * y + z[1];
+			z[1] = c[2] * x - c[4] * y;
+			x = y;
+		}
+		state->energy[i] += x * x;
+	}
+}
+
+void filter_band_samples(FilterBankState* state, const i16* samples, u32 count)
+{
+	for(u32 i = 0; i < count; i++) {
+		f32 value = samples[i];
+		run_band_level(state, 0, value);
+		for(u32 level = 1; level < s_band_level_count; level++) {
+			if(!halfband_push(&state->halfbands[level - 1], value, &value)) break;
+			run_band_level(state, level, value);
+		}
+	}
+	state->position += count;
+}
+
+//NOTE: runs the bank up to `end` and writes the time weighted levels. A bank with a different layout or one that fell behind the
+// ring starts over at `restart`, or the oldest sample the ring still holds if that is later, like decimate_until.
+void filter_bank_levels(FilterBankState* state, SampleRing* ring, u64 end, u64 restart, u32 sample_rate, f32* levels)
+{
+	u64 read_count = ring->read_count.load(std::memory_order_relaxed);
+	if(state->key != s_octave_key || state->position < read_count || state->position > end) {
+		reset_filter_bank(state, s_octave_key, min(max(restart, read_count), end));
+	}
+
+	RingSpan span = ring_span(ring, state->position, (u32)(end - state->position));
+	filter_band_samples(state, span.first, span.first_length);
+	filter_band_samples(state, span.second, span.second_length);
+
+	for(u32 i = 0; i < s_octave_band_count; i++) {
+		u32 level = s_octave_bands[i].level;
+		u32 count = state->samples[level];
+		if(count) {
+			f64 mean_square = state->energy[i] / count;
+			f64 alpha = state->weighted ? 1 - exp(-(f64)count / (sample_rate >> level) / BAND_TIME_CONSTANT) : 1;
+			state->mean_square[i] += alpha * (mean_square - state->mean_square[i]);
+			state->energy[i] = 0;
+		}
+		levels[i] = band_level(state->mean_square[i]);
+	}
+	for(u32 level = 0; level < MAX_BAND_LEVELS; level++) state->weighted |= state->samples[level] > 0;
+	memset(state->samples, 0, sizeof(state->samples));
+}
@@ -0,0 +1,184 @@
+#pragma once
+#include <float.h>
+#include <math.h>
+#include "basetypes.h"
+#include "platform.h"
+#include "fft.cpp"
+
+///////////////////////////////////////////////////////////
+//                     Peak Detection                    //
+///////////////////////////////////////////////////////////
+
+//NOTE: runs on the magnitudes of every frame. Local maxima that stand PEAK_THRESHOLD_DB above the noise floor (psd.cpp) around
+// them are candidates. The floor a bin gets compared against is the lowest one within PEAK_FLOOR_BLOCK bins or more: a tone that
+// stays put long enough ends up in the per bin floor itself, but not in that of its neighbours. Only the MAX_PEAKS strongest
+// survive the scan and get interpolated to sub-bin accuracy from their neighbours:
+//  parabolic - parabola through the three magnitudes
+//  gaussian  - parabola through their logs, exact for a gaussian window and within a few hundredths of a bin for hann
+// Peaks then get matched to the tracks of the previous frames, the strongest peak first, so labels keep their identity while a
+// tone drifts. The scan is one compare per bin for everything below the threshold, so it keeps up with every hop of every device.
+enum PeakInterpolation : u32 {
+	PEAK_INTERPOLATION_PARABOLIC,
+	PEAK_INTERPOLATION_GAUSSIAN,
+
+	PEAK_INTERPOLATION_COUNT,
+};
+
+global const char* s_peak_interpolation_names[PEAK_INTERPOLATION_COUNT] = { "parabolic", "gaussian" };
+
+global const f32 PEAK_THRESHOLD_DB    = 10.0f;
+global const f32 PEAK_TRACK_TOLERANCE = 2.0f; // bins a track may move from one frame to the next
+global const u32 PEAK_TRACK_HOLD      = 4;    // frames a track survives without a peak
+global const u32 MAX_PEAK_TRACKS      = MAX_PEAKS * 2;
+global const u32 PEAK_FLOOR_BLOCK     = 16;   // well beyond the main lobe of every window
+global const u32 PEAK_FLOOR_BLOCKS    = (MAX_FFT_SIZE / 2 + 1 + PEAK_FLOOR_BLOCK - 1) / PEAK_FLOOR_BLOCK;
+
+struct PeakCandidate {
+	u32 bin;
+	f32 magnitude;
+};
+
+struct PeakTrack {
+	u32 id;
+	f32 frequency;
+	u32 age;
+	u32 missed;
+};
+
+struct PeakTracker {
+	u32           candidate_count;
+	PeakCandidate candidates[MAX_PEAKS]; // strongest first
+	u32           peak_count;
+	Peak          peaks[MAX_PEAKS];      // the candidates of the newest frame after interpolation and tracking
+	u32           track_count;
+	PeakTrack     tracks[MAX_PEAK_TRACKS];
+	u32           next_id;
+	f32           block_floor[PEAK_FLOOR_BLOCKS];
+	f32           threshold[PEAK_FLOOR_BLOCKS]; // power a peak in the block has to exceed
+};
+
+global PeakInterpolation s_peak_interpolation = PEAK_INTERPOLATION_GAUSSIAN;
+global bool              s_show_peaks;
+
+// `noise` is in |X|^2 like the psd state keeps it
+void compute_peak_thresholds(PeakTracker* tracker, const f32* noise, u32 bin_count)
+{
+	u32 blocks = (bin_count + PEAK_FLOOR_BLOCK - 1) / PEAK_FLOOR_BLOCK;
+	for(u32 b = 0; b < blocks; b++) {
+		u32 end = min((b + 1) * PEAK_FLOOR_BLOCK, bin_count);
+		f32 floor = FLT_MAX;
+		for(u32 k = b * PEAK_FLOOR_BLOCK; k < end; k++) floor = min(floor, noise[k]);
+		tracker->block_floor[b] = floor;
+	}
+
+	f32 factor = powf(10.0f, PEAK_THRESHOLD_DB / 10);
+	for(u32 b = 0; b < blocks; b++) {
+		f32 floor = tracker->block_floor[b];
+		if(b > 0)          floor = min(floor, tracker->block_floor[b - 1]);
+		if(b + 1 < blocks) floor = min(floor, tracker->block_floor[b + 1]);
+		tracker->threshold[b] = floor * factor;
+	}
+}
+
+// the strongest local maxima above the threshold
+void find_peak_candidates(PeakTracker* tracker, const f32* magnitudes, u32 bin_count)
+{
+	u32 count = 0;
+	for(u32 k = 1; k + 1 < bin_count; k++) {
+		f32 m = magnitudes[k];
+		if(m * m <= tracker->threshold[k / PEAK_FLOOR_BLOCK]) continue;
+		if(m <= magnitudes[k - 1] || m < magnitudes[k + 1]) continue;
+		if(count == MAX_PEAKS && m <= tracker->candidates[count - 1].magnitude) continue;
+
+		u32 i = count < MAX_PEAKS ? count++ : count - 1;
+		for(; i > 0 && tracker->candidates[i - 1].magnitude < m; i--) tracker->candidates[i] = tracker->candidates[i - 1];
+		tracker->candidates[i] = { k, m };
+	}
+	tracker->candidate_count = count;
+}
+
+// offset of the true peak from bin k in bins and its magnitude
+void interpolate_peak(const f32* magnitudes, u32 k, PeakInterpolation interpolation, f32* offset, f32* magnitude)
+{
+	f32 a = magnitudes[k - 1];
+	f32 b = magnitudes[k];
+	f32 c = magnitudes[k + 1];
+	if(interpolation == PEAK_INTERPOLATION_GAUSSIAN) {
+		a = logf(max(a, 1e-20f));
+		b = logf(max(b, 1e-20f));
+		c = logf(max(c, 1e-20f));
+	}
+
+	f32 curvature = a - 2 * b + c;
+	f32 delta = curvature < 0 ? 0.5f * (a - c) / curvature : 0;
+	delta = max(min(delta, 0.5f), -0.5f);
+	f32 peak = b - 0.25f * (a - c) * delta;
+
+	*offset    = delta;
+	*magnitude = interpolation == PEAK_INTERPOLATION_GAUSSIAN ? expf(peak) : peak;
+}
+
+// greedy nearest neighbour matching, strongest peak first
+void update_peak_tracks(PeakTracker* tracker, f32 bin_width)
+{
+	bool matched[MAX_PEAK_TRACKS] = {};
+	for(u32 p = 0; p < tracker->peak_count; p++) {
+		Peak& peak = tracker->peaks[p];
+		u32 best = tracker->track_count;
+		f32 best_distance = PEAK_TRACK_TOLERANCE * bin_width;
+		for(u32 t = 0; t < tracker->track_count; t++) {
+			f32 distance = fabsf(tracker->tracks[t].frequency - peak.frequency);
+			if(matched[t] || distance > best_distance) continue;
+			best = t;
+			best_distance = distance;
+		}
+		if(best == tracker->track_count) {
+			if(best == MAX_PEAK_TRACKS) {
+				peak.track = 0;
+				peak.age   = 0;
+				continue;
+			}
+			tracker->tracks[best] = { .id = ++tracker->next_id };
+			tracker->track_count++;
+		}
+
+		PeakTrack& track = tracker->tracks[best];
+		matched[best]   = true;
+		track.frequency = peak.frequency;
+		track.age++;
+		track.missed    = 0;
+		peak.track      = track.id;
+		peak.age        = track.age;
+	}
+
+	// tracks without a peak are held for a few frames so a peak that dips below the threshold once keeps its id
+	u32 kept = 0;
+	for(u32 t = 0; t < tracker->track_count; t++) {
+		PeakTrack track = tracker->tracks[t];
+		if(!matched[t] && ++track.missed > PEAK_TRACK_HOLD) continue;
+		tracker->tracks[kept++] = track;
+	}
+	tracker->track_count = kept;
+}
+
+//NOTE: `bin_width` in Hz and `window_sum` are what the frame was computed with, levels come out as A / 2 like the linear spectrum
+void detect_peaks(PeakTracker* tracker, const f32* magnitudes, const f32* noise, u32 bin_count, f32 bin_width, f64 window_sum, PeakInterpolation interpolation)
+{
+	compute_peak_thresholds(tracker, noise, bin_count);
+	find_peak_candidates(tracker, magnitudes, bin_count);
+
+	tracker->peak_count = tracker->candidate_count;
+	for(u32 p = 0; p < tracker->candidate_count; p++) {
+		f32 offset, magnitude;
+		interpolate_peak(magnitudes, tracker->candidates[p].bin, interpolation, &offset, &magnitude);
+		tracker->peaks[p].frequency = (tracker->candidates[p].bin + offset) * bin_width;
+		tracker->peaks[p].level     = magnitude / (f32)window_sum;
+	}
+	update_peak_tracks(tracker, bin_width);
+}
+
+void clear_peaks(PeakTracker* tracker)
+{
+	tracker->peak_count = 0;
+	update_peak_tracks(tracker, 0);
+}
@@ -0,0 +1,200 @@
+#pragma once
+#include <math.h>
+#include "basetypes.h"
+#include "platform.h"
+#include "stft.cpp"
+#include "fft.cpp"
+#include "simd.cpp"
+#include "sample_ring.cpp"
+#include "peaks.cpp"
+
+///////////////////////////////////////////////////////////
+//                     Pitch Tracking                    //
+///////////////////////////////////////////////////////////
+
+//NOTE: fundamental frequency of every frame, either from the frame's spectrum or from the samples around it:
+//  hps - harmonic product spectrum. Every candidate bin k between PITCH_MIN_FREQUENCY and PITCH_MAX_FREQUENCY scores the sum of the
+//        log magnitudes of its first HPS_HARMONICS harmonics, the strongest bin within half a bin of h * k each so low
+//        fundamentals still hit their upper harmonics. A score that is just as good an octave lower wins, otherwise a tone with
+//        strong even harmonics reads an octave high. The winner gets refined by interpolating every harmonic's peak, the
+//        confidence is the share of the power below the last harmonic that sits in the harmonics.
+//  yin - de Cheveigne & Kawahara on the last YIN_FRAME samples of the frame at the full rate. The difference function
+//        d(tau) = e(0) + e(tau) - 2 r(tau) gets its cross term from an fft correlation and the energies from prefix sums, so the
+//        whole thing is two forward and one inverse YIN_FRAME point transform. The pitch is the first dip of the cumulative mean
+//        normalized difference below YIN_THRESHOLD, the confidence is 1 minus its depth.
+// Both run with every hop, YIN costs about three 4096 point ffts per frame.
+enum PitchMethod : u32 {
+	PITCH_METHOD_OFF,
+	PITCH_METHOD_HPS,
+	PITCH_METHOD_YIN,
+
+	PITCH_METHOD_COUNT,
+};
+
+global const char* s_pitch_method_names[PITCH_METHOD_COUNT] = { "off", "hps", "yin" };
+
+global const f32 PITCH_MIN_FREQUENCY = 30.0f;
+global const f32 PITCH_MAX_FREQUENCY = 2000.0f;
+global const u32 HPS_HARMONICS       = 5;
+global const f32 HPS_OCTAVE_DB       = 6.0f;  // per harmonic, how much worse the score an octave lower may be and still win
+global const u32 YIN_FFT_SIZE_INDEX  = 2;     // into s_fft_plans, its forward plan gets reused
+global const u32 YIN_FRAME           = 4096;
+global const u32 YIN_WINDOW          = YIN_FRAME / 2; // integration window, also the longest lag
+global const f32 YIN_THRESHOLD       = 0.15f;
+
+struct PitchState {
+	f32*           scratch;     // hps: log magnitudes
+	f32*           samples;     // yin: the frame, fed to the forward transform as it is
+	f32*           head;        // yin: the first YIN_WINDOW samples, zero padded
+	fftwf_complex* head_bins;
+	fftwf_complex* sample_bins;
+	f32*           correlation;
+	f64*           energy;      // prefix sums of the squared samples
+	f32*           difference;
+};
+
+global PitchMethod s_pitch_method = PITCH_METHOD_OFF;
+global fftwf_plan  s_yin_inverse_plan;
+
+//NOTE: like the other plans the inverse one is created on the first device's buffers and executed on everyone's
+void create_pitch_plans(PitchState* states, u32 device_count)
+{
+	for(u32 d = 0; d < device_count; d++) {
+		PitchState& state = states[d];
+		state.scratch     = (f32*)r_allocate((MAX_FFT_SIZE / 2 + 1) * sizeof(f32));
+		state.samples     = fftwf_alloc_real(YIN_FRAME);
+		state.head        = fftwf_alloc_real(YIN_FRAME);
+		state.head_bins   = fftwf_alloc_complex(YIN_FRAME / 2 + 1);
+		state.sample_bins = fftwf_alloc_complex(YIN_FRAME / 2 + 1);
+		state.correlation = fftwf_alloc_real(YIN_FRAME);
+		state.energy      = (f64*)r_allocate((YIN_FRAME + 1) * sizeof(f64));
+		state.difference  = (f32*)r_allocate(YIN_WINDOW * sizeof(f32));
+	}
+	if(!device_count) return;
+
+	f64 start = get_seconds();
+	s_yin_inverse_plan = fftwf_plan_dft_c2r_1d(YIN_FRAME, states[0].sample_bins, states[0].correlation, s_plan_quality_flags[s_plan_quality]);
+	s_plan_report.plans_created++;
+	s_plan_report.planning_seconds += get_seconds() - start;
+}
+
+// strongest bin within `half_width` bins of `center`
+u32 strongest_bin_near(const f32* values, f32 center, f32 half_width)
+{
+	u32 first = (u32)ceilf(max(center - half_width, 1.0f));
+	u32 last  = (u32)floorf(center + half_width);
+	u32 best  = first;
+	for(u32 k = first + 1; k <= last; k++) if(values[k] > values[best]) best = k;
+	return best;
+}
+
+f32 hps_score(const f32* log_magnitudes, u32 k)
+{
+	f32 score = 0;
+	for(u32 h = 1; h <= HPS_HARMONICS; h++) {
+		score += log_magnitudes[strongest_bin_near(log_magnitudes, (f32)h * k, h * 0.5f)];
+	}
+	return score;
+}
+
+PitchEstimate estimate_pitch_hps(PitchState* state, const f32* magnitudes, u32 bin_count, f32 bin_width)
+{
+	PitchEstimate estimate = {};
+	u32 k_min = max((u32)(PITCH_MIN_FREQUENCY / bin_width), 2u);
+	u32 k_max = min((u32)(PITCH_MAX_FREQUENCY / bin_width), (bin_count - 2) / HPS_HARMONICS - 1);
+	if(k_min >= k_max) return estimate;
+
+	u32 used_bins = min((k_max + 1) * HPS_HARMONICS + HPS_HARMONICS, bin_count);
+	f32* log_magnitudes = state->scratch;
+	magnitudes_to_decibels(magnitudes, log_magnitudes, used_bins, 0);
+
+	u32 best = k_min;
+	f32 best_score = hps_score(log_magnitudes, k_min);
+	for(u32 k = k_min + 1; k <= k_max; k++) {
+		f32 score = hps_score(log_magnitudes, k);
+		if(score > best_score) {
+			best = k;
+			best_score = score;
+		}
+	}
+	while(best / 2 >= k_min && hps_score(log_magnitudes, best / 2) > best_score - HPS_OCTAVE_DB * HPS_HARMONICS) best /= 2;
+
+	// every harmonic's interpolated peak divided by its number, weighted by its power
+	f32 weighted = 0, weights = 0, harmonic_power = 0;
+	for(u32 h = 1; h <= HPS_HARMONICS; h++) {
+		u32 k = strongest_bin_near(magnitudes, (f32)h * best, h * 0.5f);
+		f32 offset, magnitude;
+		interpolate_peak(magnitudes, k, PEAK_INTERPOLATION_GAUSSIAN, &offset, &magnitude);
+		f32 power = magnitude * magnitude;
+		weighted += (k + offset) * bin_width / h * power;
+		weights  += power;
+		for(u32 j = k - 1; j <= k + 1; j++) harmonic_power += magnitudes[j] * magnitudes[j];
+	}
+	u32 last_bin = min((u32)((HPS_HARMONICS + 0.5f) * best), bin_count - 1);
+	f32 total_power = 0;
+	for(u32 k = 1; k <= last_bin; k++) total_power += magnitudes[k] * magnitudes[k];
+
+	if(weights > 0) estimate.frequency = weighted / weights;
+	if(total_power > 0) estimate.confidence = min(harmonic_power / total_power, 1.0f);
+	return estimate;
+}
+
+//NOTE: `frame_end` is in samples of the full rate ring, the ring always holds MAX_FFT_SIZE samples before the newest frame
+PitchEstimate estimate_pitch_yin(PitchState* state, SampleRing* ring, u64 frame_end, u32 sample_rate)
+{
+	PitchEstimate estimate = {};
+	if(frame_end < YIN_FRAME) return estimate;
+
+	RingSpan span = ring_span(ring, frame_end - YIN_FRAME, YIN_FRAME);
+	for(u32 i = 0; i < span.first_length; i++)  state->samples[i] = span.first[i];
+	for(u32 i = 0; i < span.second_length; i++) state->samples[span.first_length + i] = span.second[i];
+	memcpy(state->head, state->samples, YIN_WINDOW * sizeof(f32));
+	memset(state->head + YIN_WINDOW, 0, (YIN_FRAME - YIN_WINDOW) * sizeof(f32));
+
+	state->energy[0] = 0;
+	for(u32 i = 0; i < YIN_FRAME; i++) state->energy[i + 1] = state->energy[i] + (f64)state->samples[i] * state->samples[i];
+
+	// r(tau) = sum of head[j] * samples[j + tau] is the inverse of conj(head) * samples, the zero padding keeps it from wrapping
+	FFTPlan& forward = s_fft_plans[YIN_FFT_SIZE_INDEX];
+	fftwf_execute_dft_r2c(forward.plan, state->head, state->head_bins);
+	fftwf_execute_dft_r2c(forward.plan, state->samples, state->sample_bins);
+	for(u32 k = 0; k <= YIN_FRAME / 2; k++) {
+		f32 a_re = state->head_bins[k][0], a_im = state->head_bins[k][1];
+		f32 b_re = state->sample_bins[k][0], b_im = state->sample_bins[k][1];
+		state->sample_bins[k][0] = a_re * b_re + a_im * b_im;
+		state->sample_bins[k][1] = a_re * b_im - a_im * b_re;
+	}
+	fftwf_execute_dft_c2r(s_yin_inverse_plan, state->sample_bins, state->correlation);
+
+	// cumulative mean normalized difference, d'(0) = 1
+	u32 tau_min = max((u32)(sample_rate / PITCH_MAX_FREQUENCY), 2u);
+	u32 tau_max = min((u32)(sample_rate / PITCH_MIN_FREQUENCY), YIN_WINDOW - 2);
+	f32* difference = state->difference;
+	f64 e0 = state->energy[YIN_WINDOW];
+	f64 running_sum = 0;
+	difference[0] = 1;
+	for(u32 tau = 1; tau <= tau_max + 1; tau++) {
+		f64 e_tau = state->energy[tau + YIN_WINDOW] - state->energy[tau];
+		f64 d = max(e0 + e_tau - 2.0 * state->correlation[tau] / YIN_FRAME, 0.0);
+		running_sum += d;
+		difference[tau] = running_sum > 0 ? (f32)(d * tau / running_sum) : 1;
+	}
+
+	u32 tau = tau_min;
+	while(tau <= tau_max && difference[tau] >= YIN_THRESHOLD) tau++;
+	if(tau > tau_max) {
+		// no dip deep enough, report the deepest one with its low confidence
+		tau = tau_min;
+		for(u32 t = tau_min + 1; t <= tau_max; t++) if(difference[t] < difference[tau]) tau = t;
+	}
+	else {
+		while(tau < tau_max && difference[tau + 1] < difference[tau]) tau++;
+	}
+
+	f32 a = difference[tau - 1], b = difference[tau], c = difference[tau + 1];
+	f32 curvature = a - 2 * b + c;
+	f32 offset = curvature > 0 ? max(min(0.5f * (a - c) / curvature, 0.5f), -0.5f) : 0;
+	estimate.frequency  = sample_rate / (tau + offset);
+	estimate.confidence = max(1 - b, 0.0f);
+	return estimate;
+}
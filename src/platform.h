@@ -19,6 +19,23 @@ struct FileMemory {
 FileMemory read_entire_file(char* filename);
 FileMemory read_entire_file(const char filename[]) { return read_entire_file((char*)filename); }
 void free_file(FileMemory file);
+void* open_output_file(const char* filename); // truncates, 0 on failure
+bool  write_file(void* file, const void* data, u32 size);
+void  close_file(void* file);
+
+f64  get_seconds();
+
+typedef void ThreadFunction(void* data);
+void* start_thread(ThreadFunction* function, void* data);
+void  join_thread(void* thread);
+void  sleep_milliseconds(u32 milliseconds);
+u32   get_processor_count();
+
+void* create_semaphore();
+void  wait_semaphore(void* semaphore);
+void  signal_semaphore(void* semaphore, u32 count);
+
+void get_executable_relative_path(char* dst, u32 dst_size, const char* file_name);
 
 struct RenderBuffer;
 
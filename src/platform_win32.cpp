@@ -3,9 +3,7 @@
 #include <initguid.h>
 #include <dsound.h>
 #include "basetypes.h"
-
-void* r_allocate(u32 size_bytes) { return VirtualAlloc(0, size_bytes, MEM_COMMIT, PAGE_READWRITE); }
-void r_free(void* memory) { VirtualFree(memory, 0, MEM_RELEASE); }
+#include "platform_win32_system.cpp"
 
 struct Win32Buffer {
 	BITMAPINFO info;
@@ -19,38 +17,10 @@ struct Win32Buffer {
 struct Win32CaptureDevice {
 	LPDIRECTSOUNDCAPTUREBUFFER capture_buffer;
 	u32                        capture_buffer_size;
-	u32                        current_capture_read_progress;
-	i16*                       samples_buffer;
+	u32                        copied_capture_pos; // only touched by the capture thread
 	f32*                       spectrum_buffer;
 };
 
-FileMemory read_entire_file(char* filename)
-{
-
-	HANDLE file = CreateFile(filename, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, 0, 0);
-	if(file != INVALID_HANDLE_VALUE) {
-		LARGE_INTEGER size;
-		if(GetFileSizeEx(file, &size)) {
-			FileMemory result = {};
-			result.size = size.QuadPart;
-			result.memory = VirtualAlloc(0, result.size, MEM_COMMIT, PAGE_READWRITE);
-			//TODO(Rennorb): loop for actual 64 bit read
-			if(ReadFile(file, result.memory, size.QuadPart, 0, 0)) {
-				return result;
-			}
-		}
-
-		CloseHandle(file);
-	}
-
-	return {};
-}
-
-void free_file(FileMemory file)
-{
-	VirtualFree(file.memory, 0, MEM_RELEASE);
-}
-
 ///////////////////////////////////////////////////////////
 //                    Platform Main                      //
 ///////////////////////////////////////////////////////////
@@ -67,7 +37,7 @@ global Win32Buffer s_backbuffer = {
 	}
 };
 
-void init();
+void init(char* command_line);
 void window_resized(u32 w, u32 h);
 void key_down(u32 key_code);
 void update();
@@ -146,7 +116,7 @@ LRESULT CALLBACK MainWindowCallback(
 		} break;
 
 		case WM_KEYDOWN: {
-			
+			key_down((u32)wParam);
 
 			result = DefWindowProc(window, message, wParam, lParam);
 		} break;
@@ -220,7 +190,7 @@ int CALLBACK WinMain(
 		return 2;
 	}
 
-	init();
+	init(command_line);
 	
 	s_running = true;
 	MSG message;
@@ -0,0 +1,134 @@
+#pragma once
+#include <windows.h>
+#include "basetypes.h"
+#include "platform.h"
+
+///////////////////////////////////////////////////////////
+//                    Win32 System                       //
+///////////////////////////////////////////////////////////
+
+//NOTE: the platform functions that need neither a window nor DirectSound, the tests link against this part alone
+
+void* r_allocate(u32 size_bytes) { return VirtualAlloc(0, size_bytes, MEM_COMMIT, PAGE_READWRITE); }
+void r_free(void* memory) { VirtualFree(memory, 0, MEM_RELEASE); }
+
+FileMemory read_entire_file(char* filename)
+{
+
+	HANDLE file = CreateFile(filename, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, 0, 0);
+	if(file != INVALID_HANDLE_VALUE) {
+		LARGE_INTEGER size;
+		if(GetFileSizeEx(file, &size)) {
+			FileMemory result = {};
+			result.size = size.QuadPart;
+			result.memory = VirtualAlloc(0, result.size, MEM_COMMIT, PAGE_READWRITE);
+			//TODO(Rennorb): loop for actual 64 bit read
+			if(ReadFile(file, result.memory, size.QuadPart, 0, 0)) {
+				return result;
+			}
+		}
+
+		CloseHandle(file);
+	}
+
+	return {};
+}
+
+void free_file(FileMemory file)
+{
+	VirtualFree(file.memory, 0, MEM_RELEASE);
+}
+
+void* open_output_file(const char* filename)
+{
+	HANDLE file = CreateFile(filename, GENERIC_WRITE, FILE_SHARE_READ, 0, CREATE_ALWAYS, 0, 0);
+	return file != INVALID_HANDLE_VALUE ? file : 0;
+}
+
+bool write_file(void* file, const void* data, u32 size)
+{
+	DWORD written = 0;
+	return WriteFile((HANDLE)file, data, size, &written, 0) && written == size;
+}
+
+void close_file(void* file)
+{
+	CloseHandle((HANDLE)file);
+}
+
+f64 get_seconds()
+{
+	static LARGE_INTEGER frequency = {};
+	if(!frequency.QuadPart) QueryPerformanceFrequency(&frequency);
+
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	return (f64)counter.QuadPart / frequency.QuadPart;
+}
+
+void get_executable_relative_path(char* dst, u32 dst_size, const char* file_name)
+{
+	u32 length = GetModuleFileName(0, dst, dst_size);
+	while(length > 0 && dst[length - 1] != '\\' && dst[length - 1] != '/') length--;
+
+	u32 name_length = strlen(file_name);
+	if(length + name_length >= dst_size) {
+		dst[0] = 0;
+		return;
+	}
+	memcpy(dst + length, file_name, name_length + 1);
+}
+
+struct Win32ThreadStart {
+	ThreadFunction* function;
+	void*           data;
+};
+
+DWORD WINAPI win32_thread_entry(LPVOID parameter)
+{
+	Win32ThreadStart start = *(Win32ThreadStart*)parameter;
+	r_free(parameter);
+	start.function(start.data);
+	return 0;
+}
+
+void* start_thread(ThreadFunction* function, void* data)
+{
+	Win32ThreadStart* start = (Win32ThreadStart*)r_allocate(sizeof(Win32ThreadStart));
+	start->function = function;
+	start->data     = data;
+	return CreateThread(0, 0, win32_thread_entry, start, 0, 0);
+}
+
+void join_thread(void* thread)
+{
+	WaitForSingleObject(thread, INFINITE);
+	CloseHandle(thread);
+}
+
+void sleep_milliseconds(u32 milliseconds)
+{
+	Sleep(milliseconds);
+}
+
+u32 get_processor_count()
+{
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors;
+}
+
+void* create_semaphore()
+{
+	return CreateSemaphore(0, 0, 0x7fffffff, 0);
+}
+
+void wait_semaphore(void* semaphore)
+{
+	WaitForSingleObject(semaphore, INFINITE);
+}
+
+void signal_semaphore(void* semaphore, u32 count)
+{
+	ReleaseSemaphore(semaphore, count, 0);
+}
@@ -0,0 +1,225 @@
+#pragma once
+#include <float.h>
+#include <math.h>
+#include "basetypes.h"
+#include "platform.h"
+#include "stft.cpp"
+#include "fft.cpp"
+
+///////////////////////////////////////////////////////////
+//                 Power Spectral Density                //
+///////////////////////////////////////////////////////////
+
+//NOTE: averaging of the per frame power |X|^2 at bin resolution, fed with every frame of a round:
+//  linear      - mean of blocks of PSD_AVERAGE_FRAMES frames, the estimate changes once per block
+//  exponential - cumulative mean for the first PSD_AVERAGE_FRAMES frames, exponential with a time constant of that many after
+//  welch       - mean of the last PSD_AVERAGE_FRAMES frames. The frames are windowed segments that overlap by the stft hop,
+//                which makes this welch's method with a new estimate every frame
+// Besides that every bin tracks a noise floor with minimum statistics (Martin 2001): the minimum of the recursively smoothed power
+// over the last NOISE_SUBWINDOWS * NOISE_SUBWINDOW_FRAMES frames, tracked per subwindow so old minima drop out, times a bias
+// correction since the minimum of a noisy estimate sits below its mean. Tones and other short lived peaks don't raise it.
+// Everything lives in arrays sized for the largest fft that get updated in place, a change of the fft size, decimation, window
+// or averaging mode starts over.
+enum PsdAveraging : u32 {
+	PSD_AVERAGING_OFF,
+	PSD_AVERAGING_LINEAR,
+	PSD_AVERAGING_EXPONENTIAL,
+	PSD_AVERAGING_WELCH,
+
+	PSD_AVERAGING_COUNT,
+};
+
+global const char* s_psd_averaging_names[PSD_AVERAGING_COUNT] = { "off", "linear", "exponential", "welch" };
+
+global const u32 PSD_AVERAGE_FRAMES     = 16;
+global const u32 PSD_MAX_BINS           = MAX_FFT_SIZE / 2 + 1;
+global const f32 NOISE_SMOOTHING        = 0.85f;
+global const u32 NOISE_SUBWINDOWS       = 8;
+global const u32 NOISE_SUBWINDOW_FRAMES = 12;
+global const f32 NOISE_BIAS_M           = 0.875f; // M(D) from Martin's table for D = NOISE_SUBWINDOWS * NOISE_SUBWINDOW_FRAMES = 96
+
+struct PsdState {
+	u32          key; // what the bins belong to, see psd_key
+	PsdAveraging averaging;
+	u32          bin_count;
+
+	u32  frames;          // linear: frames in the current block, exponential / welch: frames so far up to PSD_AVERAGE_FRAMES
+	f32* sum;             // linear / welch: sum of the frames, exponential: the average itself
+	f32* history;         // welch: power of the last PSD_AVERAGE_FRAMES frames
+	u32  history_index;
+	f32* average;         // newest complete estimate of |X|^2
+	bool average_valid;
+
+	f32* smoothed;
+	f32* subwindow_minimum;
+	f32* minima;          // NOISE_SUBWINDOWS arrays of bin_count, minima of the last complete subwindows
+	f32* minimum;         // minimum over `minima`
+	u32  noise_frames;    // frames since the start
+	f32* noise;           // bias corrected noise floor in |X|^2
+	f32* scratch;
+};
+
+global PsdAveraging s_psd_averaging = PSD_AVERAGING_OFF;
+global bool         s_show_noise_floor;
+
+void allocate_psd_state(PsdState* state)
+{
+	u32 bytes = PSD_MAX_BINS * sizeof(f32);
+	state->sum               = (f32*)r_allocate(bytes);
+	state->history           = (f32*)r_allocate(bytes * PSD_AVERAGE_FRAMES);
+	state->average           = (f32*)r_allocate(bytes);
+	state->smoothed          = (f32*)r_allocate(bytes);
+	state->subwindow_minimum = (f32*)r_allocate(bytes);
+	state->minima            = (f32*)r_allocate(bytes * NOISE_SUBWINDOWS);
+	state->minimum           = (f32*)r_allocate(bytes);
+	state->noise             = (f32*)r_allocate(bytes);
+	state->scratch           = (f32*)r_allocate(bytes);
+}
+
+u32 psd_key(u32 size_index, u32 decimation_stages, WindowFunction window_function)
+{
+	return size_index | decimation_stages << 8 | window_function << 16;
+}
+
+//NOTE: Martin's approximation of how far the minimum of D smoothed estimates sits below the mean. Smoothing periodograms of noise
+// (2 degrees of freedom) with alpha gives Q = 2 (1 + alpha) / (1 - alpha) equivalent degrees of freedom.
+f32 noise_bias()
+{
+	f32 q = 2 * (1 + NOISE_SMOOTHING) / (1 - NOISE_SMOOTHING);
+	f32 q_tilde = (q - NOISE_BIAS_M) / (1 - NOISE_BIAS_M);
+	return 1 + (NOISE_SUBWINDOWS * NOISE_SUBWINDOW_FRAMES - 1) * 2 / q_tilde;
+}
+
+void restart_psd(PsdState* state, u32 key, PsdAveraging averaging, u32 bin_count)
+{
+	state->key           = key;
+	state->averaging     = averaging;
+	state->bin_count     = bin_count;
+	state->frames        = 0;
+	state->history_index = 0;
+	state->average_valid = false;
+	state->noise_frames  = 0;
+	memset(state->sum, 0, bin_count * sizeof(f32));
+	for(u32 k = 0; k < bin_count; k++) state->subwindow_minimum[k] = FLT_MAX;
+	for(u32 k = 0; k < bin_count; k++) state->minimum[k] = FLT_MAX;
+}
+
+void average_frame(PsdState* state, const f32* power)
+{
+	u32 bin_count = state->bin_count;
+	switch(state->averaging) {
+		case PSD_AVERAGING_OFF: {
+		} break;
+
+		case PSD_AVERAGING_LINEAR: {
+			for(u32 k = 0; k < bin_count; k++) state->sum[k] += power[k];
+			if(++state->frames < PSD_AVERAGE_FRAMES) break;
+			for(u32 k = 0; k < bin_count; k++) state->average[k] = state->sum[k] / PSD_AVERAGE_FRAMES;
+			memset(state->sum, 0, bin_count * sizeof(f32));
+			state->frames = 0;
+			state->average_valid = true;
+		} break;
+
+		case PSD_AVERAGING_EXPONENTIAL: {
+			state->frames = min(state->frames + 1, PSD_AVERAGE_FRAMES);
+			f32 alpha = 1.0f / state->frames;
+			for(u32 k = 0; k < bin_count; k++) state->average[k] += alpha * (power[k] - state->average[k]);
+			state->average_valid = true;
+		} break;
+
+		case PSD_AVERAGING_WELCH: {
+			f32* oldest = state->history + (u64)state->history_index * PSD_MAX_BINS;
+			if(state->frames < PSD_AVERAGE_FRAMES) {
+				for(u32 k = 0; k < bin_count; k++) state->sum[k] += power[k];
+				state->frames++;
+			}
+			else {
+				for(u32 k = 0; k < bin_count; k++) state->sum[k] += power[k] - oldest[k];
+			}
+			memcpy(oldest, power, bin_count * sizeof(f32));
+			state->history_index = (state->history_index + 1) % PSD_AVERAGE_FRAMES;
+
+			// the running sum picks up rounding errors, it gets rebuilt from the history every time that wraps
+			if(state->history_index == 0 && state->frames == PSD_AVERAGE_FRAMES) {
+				memset(state->sum, 0, bin_count * sizeof(f32));
+				for(u32 f = 0; f < PSD_AVERAGE_FRAMES; f++) {
+					f32* frame = state->history + (u64)f * PSD_MAX_BINS;
+					for(u32 k = 0; k < bin_count; k++) state->sum[k] += frame[k];
+				}
+			}
+			f32 scale = 1.0f / state->frames;
+			for(u32 k = 0; k < bin_count; k++) state->average[k] = state->sum[k] * scale;
+			state->average_valid = true;
+		} break;
+	}
+}
+
+void track_noise_floor(PsdState* state, const f32* power)
+{
+	u32 bin_count = state->bin_count;
+	if(state->noise_frames == 0) memcpy(state->smoothed, power, bin_count * sizeof(f32));
+	for(u32 k = 0; k < bin_count; k++) {
+		state->smoothed[k] = NOISE_SMOOTHING * state->smoothed[k] + (1 - NOISE_SMOOTHING) * power[k];
+		state->subwindow_minimum[k] = min(state->subwindow_minimum[k], state->smoothed[k]);
+	}
+	state->noise_frames++;
+
+	// a finished subwindow replaces the oldest one, the minimum over all of them only changes then
+	if(state->noise_frames % NOISE_SUBWINDOW_FRAMES == 0) {
+		u32 subwindow  = state->noise_frames / NOISE_SUBWINDOW_FRAMES;
+		u32 subwindows = min(subwindow, NOISE_SUBWINDOWS);
+		memcpy(state->minima + (u64)(subwindow % NOISE_SUBWINDOWS) * PSD_MAX_BINS, state->subwindow_minimum, bin_count * sizeof(f32));
+		memcpy(state->minimum, state->subwindow_minimum, bin_count * sizeof(f32));
+		for(u32 k = 0; k < bin_count; k++) state->subwindow_minimum[k] = FLT_MAX;
+		for(u32 s = 1; s < subwindows; s++) {
+			const f32* minima = state->minima + (u64)((subwindow - s) % NOISE_SUBWINDOWS) * PSD_MAX_BINS;
+			for(u32 k = 0; k < bin_count; k++) state->minimum[k] = min(state->minimum[k], minima[k]);
+		}
+	}
+
+	f32 bias = noise_bias();
+	for(u32 k = 0; k < bin_count; k++) {
+		state->noise[k] = min(state->minimum[k], state->subwindow_minimum[k]) * bias;
+	}
+}
+
+// feeds the magnitudes of one frame
+void accumulate_psd(PsdState* state, const f32* magnitudes, u32 bin_count, u32 key, PsdAveraging averaging)
+{
+	if(state->key != key || state->averaging != averaging || state->bin_count != bin_count) {
+		restart_psd(state, key, averaging, bin_count);
+	}
+
+	f32* power = state->scratch;
+	for(u32 k = 0; k < bin_count; k++) power[k] = magnitudes[k] * magnitudes[k];
+	average_frame(state, power);
+	track_noise_floor(state, power);
+}
+
+//NOTE: one sided density of a bin's power in full scale^2 / Hz, divided by the window's power gain and the bin width.
+// Dc and nyquist don't have a mirror image, they come out twice too large, which doesn't matter for a display or detection.
+f64 psd_density_scale(FFTPlan& plan, u32 sample_rate)
+{
+	return 2.0 / (32768.0 * 32768.0 * sample_rate * plan.window_power);
+}
+
+//NOTE: writes the slot's psd and noise floor, `plan` and `sample_rate` are what the bins were computed with. An averaged slot also
+// gets the rms magnitudes of the average so the display shows that instead of the newest frame.
+// Returns the noise floor as magnitudes for the display, valid until the next frame.
+const f32* publish_psd(PsdState* state, SpectrumSlot& slot, FFTPlan& plan, u32 sample_rate)
+{
+	f32 scale = (f32)psd_density_scale(plan, sample_rate);
+	slot.averaged = state->averaging != PSD_AVERAGING_OFF && state->average_valid;
+	if(slot.averaged) {
+		for(u32 k = 0; k < state->bin_count; k++) {
+			slot.psd[k]        = state->average[k] * scale;
+			slot.magnitudes[k] = sqrtf(state->average[k]);
+		}
+	}
+	slot.noise_valid = state->noise_frames > 0;
+	for(u32 k = 0; k < state->bin_count; k++) {
+		slot.noise_floor[k] = state->noise[k] * scale;
+		state->scratch[k]   = sqrtf(state->noise[k]);
+	}
+	return state->scratch;
+}
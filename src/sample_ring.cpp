@@ -0,0 +1,90 @@
+#pragma once
+#include <atomic>
+#include "basetypes.h"
+#include "platform.h"
+
+///////////////////////////////////////////////////////////
+//                      Sample Ring                      //
+///////////////////////////////////////////////////////////
+
+//NOTE: lock free single producer / single consumer ring of captured samples. Both counters are monotonic sample counts since
+// capture start, a sample's position in the ring is its count masked by the power of two capacity.
+// The producer (capture thread) only advances write_count, the consumer (analysis) only advances read_count to the oldest sample
+// it still needs. Samples in [read_count, write_count) are never overwritten, if the consumer falls that far behind new samples
+// get dropped and counted instead.
+struct SampleRing {
+	i16*             samples;
+	u32              capacity;
+	std::atomic<u64> write_count;
+	std::atomic<u64> read_count;
+	std::atomic<u64> dropped_count;
+};
+
+// a range of the ring split at the wrap point
+struct RingSpan {
+	i16* first;
+	u32  first_length;
+	i16* second;
+	u32  second_length;
+};
+
+void ring_init(SampleRing* ring, u32 min_capacity)
+{
+	u32 capacity = 1;
+	while(capacity < min_capacity) capacity <<= 1;
+
+	ring->samples  = (i16*)r_allocate(capacity * sizeof(i16));
+	ring->capacity = capacity;
+	ring->write_count.store(0);
+	ring->read_count.store(0);
+	ring->dropped_count.store(0);
+}
+
+// producer side, returns the number of samples that fit
+u32 ring_write(SampleRing* ring, const i16* samples, u32 count)
+{
+	u64 write_count = ring->write_count.load(std::memory_order_relaxed);
+	u64 read_count  = ring->read_count.load(std::memory_order_acquire);
+	u32 free_space  = ring->capacity - (u32)(write_count - read_count);
+	if(count > free_space) {
+		ring->dropped_count.fetch_add(count - free_space, std::memory_order_relaxed);
+		count = free_space;
+	}
+
+	u32 mask  = ring->capacity - 1;
+	u32 start = write_count & mask;
+	u32 first = min(count, ring->capacity - start);
+	memcpy(ring->samples + start, samples, first * sizeof(i16));
+	memcpy(ring->samples, samples + first, (count - first) * sizeof(i16));
+
+	ring->write_count.store(write_count + count, std::memory_order_release);
+	return count;
+}
+
+// consumer side, everything written before the returned count is visible
+u64 ring_available(SampleRing* ring)
+{
+	return ring->write_count.load(std::memory_order_acquire);
+}
+
+// consumer side, the span has to lie within [read_count, ring_available())
+RingSpan ring_span(SampleRing* ring, u64 position, u32 count)
+{
+	u32 mask  = ring->capacity - 1;
+	u32 start = position & mask;
+	u32 first = min(count, ring->capacity - start);
+	return {
+		.first         = ring->samples + start,
+		.first_length  = first,
+		.second        = ring->samples,
+		.second_length = count - first,
+	};
+}
+
+// consumer side, releases everything before `position` to the producer
+void ring_release(SampleRing* ring, u64 position)
+{
+	if(position > ring->read_count.load(std::memory_order_relaxed)) {
+		ring->read_count.store(position, std::memory_order_release);
+	}
+}
@@ -0,0 +1,594 @@
+#pragma once
+#include <intrin.h>
+#include <immintrin.h>
+#include <math.h>
+#include "basetypes.h"
+
+///////////////////////////////////////////////////////////
+//                     SIMD Kernels                      //
+///////////////////////////////////////////////////////////
+
+//NOTE: every kernel has a scalar, sse2 and avx2 version, init_simd picks the widest one the cpu and os support.
+// Loads and stores are unaligned since sources like the sample ring wrap at arbitrary positions.
+
+enum SimdLevel : u32 {
+	SIMD_SCALAR,
+	SIMD_SSE2,
+	SIMD_AVX2,
+
+	SIMD_LEVEL_COUNT,
+};
+
+global const char* s_simd_level_names[SIMD_LEVEL_COUNT] = { "scalar", "sse2", "avx2" };
+global SimdLevel   s_simd_level;
+
+SimdLevel detect_simd_level()
+{
+	i32 info[4];
+	__cpuid(info, 0);
+	i32 max_leaf = info[0];
+
+	__cpuid(info, 1);
+	bool sse2    = info[3] & (1 << 26);
+	bool osxsave = info[2] & (1 << 27);
+	bool avx     = info[2] & (1 << 28);
+	if(!sse2) return SIMD_SCALAR;
+
+	// avx2 also needs the os to save the ymm registers (xcr0 bits 1 and 2)
+	if(max_leaf >= 7 && osxsave && avx && (_xgetbv(0) & 6) == 6) {
+		__cpuidex(info, 7, 0);
+		if(info[1] & (1 << 5)) return SIMD_AVX2;
+	}
+	return SIMD_SSE2;
+}
+
+// dst[i] = src[i] * window[i]
+void convert_i16_to_f32_windowed_scalar(const i16* src, const f32* window, f32* dst, u32 count)
+{
+	for(u32 i = 0; i < count; i++) {
+		dst[i] = src[i] * window[i];
+	}
+}
+
+void convert_i16_to_f32_windowed_sse2(const i16* src, const f32* window, f32* dst, u32 count)
+{
+	u32 i = 0;
+	for(; i + 8 <= count; i += 8) {
+		__m128i samples = _mm_loadu_si128((__m128i*)(src + i));
+		// interleave with itself and shift back down to sign extend to 32 bit
+		__m128i low  = _mm_srai_epi32(_mm_unpacklo_epi16(samples, samples), 16);
+		__m128i high = _mm_srai_epi32(_mm_unpackhi_epi16(samples, samples), 16);
+		_mm_storeu_ps(dst + i,     _mm_mul_ps(_mm_cvtepi32_ps(low),  _mm_loadu_ps(window + i)));
+		_mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(high), _mm_loadu_ps(window + i + 4)));
+	}
+	convert_i16_to_f32_windowed_scalar(src + i, window + i, dst + i, count - i);
+}
+
+void convert_i16_to_f32_windowed_avx2(const i16* src, const f32* window, f32* dst, u32 count)
+{
+	u32 i = 0;
+	for(; i + 16 <= count; i += 16) {
+		__m256i low  = _mm256_cvtepi16_epi32(_mm_loadu_si128((__m128i*)(src + i)));
+		__m256i high = _mm256_cvtepi16_epi32(_mm_loadu_si128((__m128i*)(src + i + 8)));
+		_mm256_storeu_ps(dst + i,     _mm256_mul_ps(_mm256_cvtepi32_ps(low),  _mm256_loadu_ps(window + i)));
+		_mm256_storeu_ps(dst + i + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(high), _mm256_loadu_ps(window + i + 8)));
+	}
+	convert_i16_to_f32_windowed_sse2(src + i, window + i, dst + i, count - i);
+}
+
+// magnitudes[i] = |bins[i]|, bins are interleaved re/im pairs like fftwf_complex
+void compute_magnitudes_scalar(const f32* bins, f32* magnitudes, u32 count)
+{
+	for(u32 i = 0; i < count; i++) {
+		f32 re = bins[i * 2];
+		f32 im = bins[i * 2 + 1];
+		magnitudes[i] = sqrtf(re * re + im * im);
+	}
+}
+
+void compute_magnitudes_sse2(const f32* bins, f32* magnitudes, u32 count)
+{
+	u32 i = 0;
+	for(; i + 4 <= count; i += 4) {
+		__m128 a  = _mm_loadu_ps(bins + i * 2);
+		__m128 b  = _mm_loadu_ps(bins + i * 2 + 4);
+		__m128 re = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+		__m128 im = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+		_mm_storeu_ps(magnitudes + i, _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(re, re), _mm_mul_ps(im, im))));
+	}
+	compute_magnitudes_scalar(bins + i * 2, magnitudes + i, count - i);
+}
+
+void compute_magnitudes_avx2(const f32* bins, f32* magnitudes, u32 count)
+{
+	u32 i = 0;
+	for(; i + 8 <= count; i += 8) {
+		__m256 a  = _mm256_loadu_ps(bins + i * 2);
+		__m256 b  = _mm256_loadu_ps(bins + i * 2 + 8);
+		// the in lane shuffles leave the bins ordered 0 1 4 5 | 2 3 6 7, the permute puts the middle 64 bit pairs back in order
+		__m256 re = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0))), 0xD8));
+		__m256 im = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1))), 0xD8));
+		_mm256_storeu_ps(magnitudes + i, _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(re, re), _mm256_mul_ps(im, im))));
+	}
+	compute_magnitudes_sse2(bins + i * 2, magnitudes + i, count - i);
+}
+
+// dst[i] = a[i] * b[i]
+void multiply_f32_scalar(const f32* a, const f32* b, f32* dst, u32 count)
+{
+	for(u32 i = 0; i < count; i++) {
+		dst[i] = a[i] * b[i];
+	}
+}
+
+void multiply_f32_sse2(const f32* a, const f32* b, f32* dst, u32 count)
+{
+	u32 i = 0;
+	for(; i + 4 <= count; i += 4) {
+		_mm_storeu_ps(dst + i, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+	}
+	multiply_f32_scalar(a + i, b + i, dst + i, count - i);
+}
+
+void multiply_f32_avx2(const f32* a, const f32* b, f32* dst, u32 count)
+{
+	u32 i = 0;
+	for(; i + 8 <= count; i += 8) {
+		_mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+	}
+	multiply_f32_sse2(a + i, b + i, dst + i, count - i);
+}
+
+// sum of a[i] * b[i]
+f32 dot_product_f32_scalar(const f32* a, const f32* b, u32 count)
+{
+	f32 sum = 0;
+	for(u32 i = 0; i < count; i++) {
+		sum += a[i] * b[i];
+	}
+	return sum;
+}
+
+f32 dot_product_f32_sse2(const f32* a, const f32* b, u32 count)
+{
+	__m128 sum = _mm_setzero_ps();
+	u32 i = 0;
+	for(; i + 4 <= count; i += 4) {
+		sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+	}
+	sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+	sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+	return _mm_cvtss_f32(sum) + dot_product_f32_scalar(a + i, b + i, count - i);
+}
+
+f32 dot_product_f32_avx2(const f32* a, const f32* b, u32 count)
+{
+	// two accumulators so consecutive adds don't wait on each other
+	__m256 sum0 = _mm256_setzero_ps();
+	__m256 sum1 = _mm256_setzero_ps();
+	u32 i = 0;
+	for(; i + 16 <= count; i += 16) {
+		sum0 = _mm256_add_ps(sum0, _mm256_mul_ps(_mm256_loadu_ps(a + i),     _mm256_loadu_ps(b + i)));
+		sum1 = _mm256_add_ps(sum1, _mm256_mul_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8)));
+	}
+	__m256 sum256 = _mm256_add_ps(sum0, sum1);
+	__m128 sum = _mm_add_ps(_mm256_castps256_ps128(sum256), _mm256_extractf128_ps(sum256, 1));
+	sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+	sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+	return _mm_cvtss_f32(sum) + dot_product_f32_sse2(a + i, b + i, count - i);
+}
+
+//NOTE: runs `count` samples through a bank of goertzel resonators, s = x + c * s1 - s2 with c = 2 cos(omega) per tone.
+// The lanes hold different tones, each one's recursion depends on its previous sample, so the wider versions keep several
+// vectors of tones in flight to hide the add latency.
+void goertzel_f32_scalar(const f32* input, u32 count, const f32* coefficients, f32* s1, f32* s2, u32 tone_count)
+{
+	for(u32 t = 0; t < tone_count; t++) {
+		f32 c = coefficients[t];
+		f32 a = s1[t];
+		f32 b = s2[t];
+		for(u32 i = 0; i < count; i++) {
+			f32 s = input[i] + c * a - b;
+			b = a;
+			a = s;
+		}
+		s1[t] = a;
+		s2[t] = b;
+	}
+}
+
+void goertzel_f32_sse2(const f32* input, u32 count, const f32* coefficients, f32* s1, f32* s2, u32 tone_count)
+{
+	u32 t = 0;
+	for(; t + 8 <= tone_count; t += 8) {
+		__m128 c0 = _mm_loadu_ps(coefficients + t), c1 = _mm_loadu_ps(coefficients + t + 4);
+		__m128 a0 = _mm_loadu_ps(s1 + t),           a1 = _mm_loadu_ps(s1 + t + 4);
+		__m128 b0 = _mm_loadu_ps(s2 + t),           b1 = _mm_loadu_ps(s2 + t + 4);
+		for(u32 i = 0; i < count; i++) {
+			__m128 x  = _mm_set1_ps(input[i]);
+			__m128 n0 = _mm_sub_ps(_mm_add_ps(x, _mm_mul_ps(c0, a0)), b0);
+			__m128 n1 = _mm_sub_ps(_mm_add_ps(x, _mm_mul_ps(c1, a1)), b1);
+			b0 = a0; a0 = n0;
+			b1 = a1; a1 = n1;
+		}
+		_mm_storeu_ps(s1 + t, a0); _mm_storeu_ps(s1 + t + 4, a1);
+		_mm_storeu_ps(s2 + t, b0); _mm_storeu_ps(s2 + t + 4, b1);
+	}
+	goertzel_f32_scalar(input, count, coefficients + t, s1 + t, s2 + t, tone_count - t);
+}
+
+void goertzel_f32_avx2(const f32* input, u32 count, const f32* coefficients, f32* s1, f32* s2, u32 tone_count)
+{
+	u32 t = 0;
+	for(; t + 32 <= tone_count; t += 32) {
+		__m256 c[4], a[4], b[4];
+		for(u32 v = 0; v < 4; v++) {
+			c[v] = _mm256_loadu_ps(coefficients + t + v * 8);
+			a[v] = _mm256_loadu_ps(s1 + t + v * 8);
+			b[v] = _mm256_loadu_ps(s2 + t + v * 8);
+		}
+		for(u32 i = 0; i < count; i++) {
+			__m256 x = _mm256_set1_ps(input[i]);
+			for(u32 v = 0; v < 4; v++) {
+				__m256 n = _mm256_sub_ps(_mm256_add_ps(x, _mm256_mul_ps(c[v], a[v])), b[v]);
+				b[v] = a[v];
+				a[v] = n;
+			}
+		}
+		for(u32 v = 0; v < 4; v++) {
+			_mm256_storeu_ps(s1 + t + v * 8, a[v]);
+			_mm256_storeu_ps(s2 + t + v * 8, b[v]);
+		}
+	}
+	for(; t + 8 <= tone_count; t += 8) {
+		__m256 c = _mm256_loadu_ps(coefficients + t);
+		__m256 a = _mm256_loadu_ps(s1 + t);
+		__m256 b = _mm256_loadu_ps(s2 + t);
+		for(u32 i = 0; i < count; i++) {
+			__m256 n = _mm256_sub_ps(_mm256_add_ps(_mm256_set1_ps(input[i]), _mm256_mul_ps(c, a)), b);
+			b = a;
+			a = n;
+		}
+		_mm256_storeu_ps(s1 + t, a);
+		_mm256_storeu_ps(s2 + t, b);
+	}
+	goertzel_f32_sse2(input, count, coefficients + t, s1 + t, s2 + t, tone_count - t);
+}
+
+//NOTE: two biquad sections in series in transposed direct form II, run over i16 samples and summed up as the energy of the
+// output, which is all a loudness meter needs. The recursion leaves nothing to vectorize per sample, so the wider versions use
+// the block form of the whole cascade as a 4th order linear system: with its state s (z1, z2 of both sections) the next n
+// outputs and the state after them are fixed linear combinations of s and the n inputs. build_biquad_cascade derives those
+// matrices by running the scalar recursion on unit states and unit inputs, sse2 steps 4 samples at a time and avx2 8.
+// All versions keep the same state, so tails and switching levels stay exact.
+struct BiquadCascade {
+	f32 coefficients[2][5];      // b0, b1, b2, a1, a2 of each section, a0 = 1
+	f32 output_from_state4[4][4]; // [state][sample]
+	f32 output_from_input4[4][4]; // [input][sample]
+	f32 state_from_state4[4][4];  // [state][new state]
+	f32 state_from_input4[4][4];  // [input][new state]
+	f32 output_from_state8[4][8];
+	f32 output_from_input8[8][8];
+	f32 state_from_state8[4][4];
+	f32 state_from_input8[8][4];
+};
+
+// one sample through the cascade in double precision, `state` gets updated
+f64 biquad_cascade_step(const f64 coefficients[2][5], f64* state, f64 x)
+{
+	for(u32 s = 0; s < 2; s++) {
+		const f64* c = coefficients[s];
+		f64 y = c[0] * x + state[2 * s];
+		state[2 * s]     = c[1] * x - c[3] * y + state[2 * s + 1];
+		state[2 * s + 1] = c[2] * x - c[4] * y;
+		x = y;
+	}
+	return x;
+}
+
+void build_biquad_cascade(BiquadCascade* cascade, const f64 coefficients[2][5])
+{
+	for(u32 s = 0; s < 2; s++) {
+		for(u32 c = 0; c < 5; c++) cascade->coefficients[s][c] = (f32)coefficients[s][c];
+	}
+
+	for(u32 block = 4; block <= 8; block += 4) {
+		// column m: start from unit state m with silence, column 4 + j: start from rest with a unit sample at j
+		for(u32 column = 0; column < 4 + block; column++) {
+			f64 state[4] = {};
+			if(column < 4) state[column] = 1;
+			f64 outputs[8];
+			for(u32 i = 0; i < block; i++) {
+				outputs[i] = biquad_cascade_step(coefficients, state, column == 4 + i ? 1.0 : 0.0);
+			}
+			for(u32 i = 0; i < block; i++) {
+				if(block == 4) {
+					if(column < 4) cascade->output_from_state4[column][i] = (f32)outputs[i];
+					else           cascade->output_from_input4[column - 4][i] = (f32)outputs[i];
+				}
+				else {
+					if(column < 4) cascade->output_from_state8[column][i] = (f32)outputs[i];
+					else           cascade->output_from_input8[column - 4][i] = (f32)outputs[i];
+				}
+			}
+			for(u32 m = 0; m < 4; m++) {
+				if(block == 4) {
+					if(column < 4) cascade->state_from_state4[column][m] = (f32)state[m];
+					else           cascade->state_from_input4[column - 4][m] = (f32)state[m];
+				}
+				else {
+					if(column < 4) cascade->state_from_state8[column][m] = (f32)state[m];
+					else           cascade->state_from_input8[column - 4][m] = (f32)state[m];
+				}
+			}
+		}
+	}
+}
+
+// returns the sum of the squared outputs, `state` holds z1, z2 of both sections
+f64 biquad_cascade_energy_i16_scalar(const i16* input, u32 count, const BiquadCascade* cascade, f32* state)
+{
+	f32 z[4] = { state[0], state[1], state[2], state[3] };
+	f64 energy = 0;
+	for(u32 i = 0; i < count; i++) {
+		f32 x = input[i];
+		for(u32 s = 0; s < 2; s++) {
+			const f32* c = cascade->coefficients[s];
+			f32 y = c[0] * x + z[2 * s];
+			z[2 * s]     = c[1] * x - c[3] * y + z[2 * s + 1];
+			z[2 * s + 1] = c[2] * x - c[4] * y;
+			x = y;
+		}
+		energy += x * x;
+	}
+	for(u32 m = 0; m < 4; m++) state[m] = z[m];
+	return energy;
+}
+
+f64 biquad_cascade_energy_i16_sse2(const i16* input, u32 count, const BiquadCascade* cascade, f32* state)
+{
+	__m128 sum = _mm_setzero_ps();
+	u32 i = 0;
+	for(; i + 4 <= count; i += 4) {
+		__m128 y = _mm_setzero_ps();
+		__m128 n = _mm_setzero_ps();
+		for(u32 k = 0; k < 4; k++) {
+			__m128 v = _mm_set1_ps(state[k]);
+			y = _mm_add_ps(y, _mm_mul_ps(v, _mm_loadu_ps(cascade->output_from_state4[k])));
+			n = _mm_add_ps(n, _mm_mul_ps(v, _mm_loadu_ps(cascade->state_from_state4[k])));
+		}
+		for(u32 k = 0; k < 4; k++) {
+			__m128 v = _mm_set1_ps(input[i + k]);
+			y = _mm_add_ps(y, _mm_mul_ps(v, _mm_loadu_ps(cascade->output_from_input4[k])));
+			n = _mm_add_ps(n, _mm_mul_ps(v, _mm_loadu_ps(cascade->state_from_input4[k])));
+		}
+		sum = _mm_add_ps(sum, _mm_mul_ps(y, y));
+		_mm_storeu_ps(state, n);
+	}
+
+	f32 lanes[4];
+	_mm_storeu_ps(lanes, sum);
+	f64 energy = (f64)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+	return energy + biquad_cascade_energy_i16_scalar(input + i, count - i, cascade, state);
+}
+
+f64 biquad_cascade_energy_i16_avx2(const i16* input, u32 count, const BiquadCascade* cascade, f32* state)
+{
+	__m256 sum = _mm256_setzero_ps();
+	u32 i = 0;
+	for(; i + 8 <= count; i += 8) {
+		__m256 y = _mm256_setzero_ps();
+		__m128 n = _mm_setzero_ps();
+		for(u32 k = 0; k < 4; k++) {
+			__m256 v = _mm256_set1_ps(state[k]);
+			y = _mm256_add_ps(y, _mm256_mul_ps(v, _mm256_loadu_ps(cascade->output_from_state8[k])));
+			n = _mm_add_ps(n, _mm_mul_ps(_mm256_castps256_ps128(v), _mm_loadu_ps(cascade->state_from_state8[k])));
+		}
+		for(u32 k = 0; k < 8; k++) {
+			__m256 v = _mm256_set1_ps(input[i + k]);
+			y = _mm256_add_ps(y, _mm256_mul_ps(v, _mm256_loadu_ps(cascade->output_from_input8[k])));
+			n = _mm_add_ps(n, _mm_mul_ps(_mm256_castps256_ps128(v), _mm_loadu_ps(cascade->state_from_input8[k])));
+		}
+		sum = _mm256_add_ps(sum, _mm256_mul_ps(y, y));
+		_mm_storeu_ps(state, n);
+	}
+
+	f32 lanes[8];
+	_mm256_storeu_ps(lanes, sum);
+	f64 energy = 0;
+	for(u32 l = 0; l < 8; l++) energy += lanes[l];
+	return energy + biquad_cascade_energy_i16_sse2(input + i, count - i, cascade, state);
+}
+
+//NOTE: polyphase interpolation for a true peak meter, TRUE_PEAK_PHASES outputs per input sample, phase p being
+// y_p[i] = sum over j of taps[p * TRUE_PEAK_TAPS + j] * x[i - j]. `input` needs TRUE_PEAK_TAPS - 1 samples of history in front of
+// it. Returns the largest |y| of all phases. The wider versions run consecutive outputs in the lanes, every tap then is one
+// multiply add of a shifted load.
+global const u32 TRUE_PEAK_PHASES = 4;
+global const u32 TRUE_PEAK_TAPS   = 12;
+
+f32 true_peak_i16_scalar(const i16* input, u32 count, const f32* taps)
+{
+	f32 peak = 0;
+	for(u32 i = 0; i < count; i++) {
+		for(u32 p = 0; p < TRUE_PEAK_PHASES; p++) {
+			f32 y = 0;
+			for(u32 j = 0; j < TRUE_PEAK_TAPS; j++) y += taps[p * TRUE_PEAK_TAPS + j] * input[(i32)i - (i32)j];
+			peak = max(peak, fabsf(y));
+		}
+	}
+	return peak;
+}
+
+f32 true_peak_i16_sse2(const i16* input, u32 count, const f32* taps)
+{
+	__m128 sign_mask = _mm_set1_ps(-0.0f);
+	__m128 peak = _mm_setzero_ps();
+	u32 i = 0;
+	for(; i + 4 <= count; i += 4) {
+		__m128 y[TRUE_PEAK_PHASES] = {};
+		for(u32 j = 0; j < TRUE_PEAK_TAPS; j++) {
+			__m128i samples = _mm_loadl_epi64((__m128i*)(input + i - j));
+			__m128  x = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(samples, samples), 16));
+			for(u32 p = 0; p < TRUE_PEAK_PHASES; p++) {
+				y[p] = _mm_add_ps(y[p], _mm_mul_ps(x, _mm_set1_ps(taps[p * TRUE_PEAK_TAPS + j])));
+			}
+		}
+		for(u32 p = 0; p < TRUE_PEAK_PHASES; p++) peak = _mm_max_ps(peak, _mm_andnot_ps(sign_mask, y[p]));
+	}
+	peak = _mm_max_ps(peak, _mm_movehl_ps(peak, peak));
+	peak = _mm_max_ss(peak, _mm_shuffle_ps(peak, peak, 1));
+	return max(_mm_cvtss_f32(peak), true_peak_i16_scalar(input + i, count - i, taps));
+}
+
+f32 true_peak_i16_avx2(const i16* input, u32 count, const f32* taps)
+{
+	__m256 sign_mask = _mm256_set1_ps(-0.0f);
+	__m256 peak = _mm256_setzero_ps();
+	u32 i = 0;
+	for(; i + 8 <= count; i += 8) {
+		__m256 y[TRUE_PEAK_PHASES] = {};
+		for(u32 j = 0; j < TRUE_PEAK_TAPS; j++) {
+			__m256 x = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128((__m128i*)(input + i - j))));
+			for(u32 p = 0; p < TRUE_PEAK_PHASES; p++) {
+				y[p] = _mm256_add_ps(y[p], _mm256_mul_ps(x, _mm256_set1_ps(taps[p * TRUE_PEAK_TAPS + j])));
+			}
+		}
+		for(u32 p = 0; p < TRUE_PEAK_PHASES; p++) peak = _mm256_max_ps(peak, _mm256_andnot_ps(sign_mask, y[p]));
+	}
+	__m128 half = _mm_max_ps(_mm256_castps256_ps128(peak), _mm256_extractf128_ps(peak, 1));
+	half = _mm_max_ps(half, _mm_movehl_ps(half, half));
+	half = _mm_max_ss(half, _mm_shuffle_ps(half, half, 1));
+	return max(_mm_cvtss_f32(half), true_peak_i16_sse2(input + i, count - i, taps));
+}
+
+//NOTE: fast log2 for the decibel conversion. The exponent comes straight from the float bits, the mantissa gets folded into
+// [sqrt(1/2), sqrt(2)) and log2 of it is the atanh series 2 / ln(2) * (s + s^3 / 3 + s^5 / 5) with s = (m - 1) / (m + 1).
+// |s| <= 0.1716 there, so the dropped terms bound the error to 2e-6 in log2. With float rounding the
+// result stays within 1e-4 dB of 20 * log10, far below anything visible.
+// Inputs are clamped to FAST_LOG_MIN so silence doesn't turn into -inf.
+global const f32 FAST_LOG_MIN        = 1e-30f;
+global const f32 FAST_LOG_SQRT2      = 1.41421356f;
+global const f32 FAST_LOG_C1         = 2.88539008f; // 2 / ln(2)
+global const f32 FAST_LOG_C3         = 0.96179669f; // 2 / (3 ln(2))
+global const f32 FAST_LOG_C5         = 0.57707802f; // 2 / (5 ln(2))
+global const f32 DECIBELS_PER_OCTAVE = 6.02059991f; // 20 * log10(2)
+
+f32 fast_log2(f32 x)
+{
+	if(x < FAST_LOG_MIN) x = FAST_LOG_MIN;
+	u32 bits;
+	memcpy(&bits, &x, sizeof(bits));
+	i32 exponent = (i32)(bits >> 23) - 127;
+	bits = (bits & 0x007fffff) | 0x3f800000;
+	f32 mantissa;
+	memcpy(&mantissa, &bits, sizeof(mantissa));
+	if(mantissa > FAST_LOG_SQRT2) {
+		mantissa *= 0.5f;
+		exponent++;
+	}
+	f32 s  = (mantissa - 1) / (mantissa + 1);
+	f32 s2 = s * s;
+	return exponent + s * (FAST_LOG_C1 + s2 * (FAST_LOG_C3 + s2 * FAST_LOG_C5));
+}
+
+// decibels[i] = 20 * log10(magnitudes[i]) + offset
+void magnitudes_to_decibels_scalar(const f32* magnitudes, f32* decibels, u32 count, f32 offset)
+{
+	for(u32 i = 0; i < count; i++) {
+		decibels[i] = fast_log2(magnitudes[i]) * DECIBELS_PER_OCTAVE + offset;
+	}
+}
+
+void magnitudes_to_decibels_sse2(const f32* magnitudes, f32* decibels, u32 count, f32 offset)
+{
+	__m128i mantissa_mask = _mm_set1_epi32(0x007fffff);
+	__m128i one_bits      = _mm_set1_epi32(0x3f800000);
+	__m128i exponent_bias = _mm_set1_epi32(127);
+	__m128  one           = _mm_set1_ps(1);
+	__m128  half          = _mm_set1_ps(0.5f);
+
+	u32 i = 0;
+	for(; i + 4 <= count; i += 4) {
+		__m128  x        = _mm_max_ps(_mm_loadu_ps(magnitudes + i), _mm_set1_ps(FAST_LOG_MIN));
+		__m128i bits     = _mm_castps_si128(x);
+		__m128  exponent = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), exponent_bias));
+		__m128  mantissa = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, mantissa_mask), one_bits));
+		// no blend in sse2, so fold by subtracting half the mantissa where it is too large
+		__m128  fold     = _mm_cmpgt_ps(mantissa, _mm_set1_ps(FAST_LOG_SQRT2));
+		mantissa = _mm_sub_ps(mantissa, _mm_and_ps(fold, _mm_mul_ps(mantissa, half)));
+		exponent = _mm_add_ps(exponent, _mm_and_ps(fold, one));
+
+		__m128 s    = _mm_div_ps(_mm_sub_ps(mantissa, one), _mm_add_ps(mantissa, one));
+		__m128 s2   = _mm_mul_ps(s, s);
+		__m128 poly = _mm_add_ps(_mm_set1_ps(FAST_LOG_C3), _mm_mul_ps(s2, _mm_set1_ps(FAST_LOG_C5)));
+		poly = _mm_mul_ps(s, _mm_add_ps(_mm_set1_ps(FAST_LOG_C1), _mm_mul_ps(s2, poly)));
+		__m128 log2 = _mm_add_ps(exponent, poly);
+		_mm_storeu_ps(decibels + i, _mm_add_ps(_mm_mul_ps(log2, _mm_set1_ps(DECIBELS_PER_OCTAVE)), _mm_set1_ps(offset)));
+	}
+	magnitudes_to_decibels_scalar(magnitudes + i, decibels + i, count - i, offset);
+}
+
+void magnitudes_to_decibels_avx2(const f32* magnitudes, f32* decibels, u32 count, f32 offset)
+{
+	__m256i mantissa_mask = _mm256_set1_epi32(0x007fffff);
+	__m256i one_bits      = _mm256_set1_epi32(0x3f800000);
+	__m256i exponent_bias = _mm256_set1_epi32(127);
+	__m256  one           = _mm256_set1_ps(1);
+
+	u32 i = 0;
+	for(; i + 8 <= count; i += 8) {
+		__m256  x        = _mm256_max_ps(_mm256_loadu_ps(magnitudes + i), _mm256_set1_ps(FAST_LOG_MIN));
+		__m256i bits     = _mm256_castps_si256(x);
+		__m256  exponent = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(bits, 23), exponent_bias));
+		__m256  mantissa = _mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(bits, mantissa_mask), one_bits));
+		__m256  fold     = _mm256_cmp_ps(mantissa, _mm256_set1_ps(FAST_LOG_SQRT2), _CMP_GT_OQ);
+		mantissa = _mm256_blendv_ps(mantissa, _mm256_mul_ps(mantissa, _mm256_set1_ps(0.5f)), fold);
+		exponent = _mm256_add_ps(exponent, _mm256_and_ps(fold, one));
+
+		__m256 s    = _mm256_div_ps(_mm256_sub_ps(mantissa, one), _mm256_add_ps(mantissa, one));
+		__m256 s2   = _mm256_mul_ps(s, s);
+		__m256 poly = _mm256_add_ps(_mm256_set1_ps(FAST_LOG_C3), _mm256_mul_ps(s2, _mm256_set1_ps(FAST_LOG_C5)));
+		poly = _mm256_mul_ps(s, _mm256_add_ps(_mm256_set1_ps(FAST_LOG_C1), _mm256_mul_ps(s2, poly)));
+		__m256 log2 = _mm256_add_ps(exponent, poly);
+		_mm256_storeu_ps(decibels + i, _mm256_add_ps(_mm256_mul_ps(log2, _mm256_set1_ps(DECIBELS_PER_OCTAVE)), _mm256_set1_ps(offset)));
+	}
+	magnitudes_to_decibels_sse2(magnitudes + i, decibels + i, count - i, offset);
+}
+
+global void (*convert_i16_to_f32_windowed)(const i16* src, const f32* window, f32* dst, u32 count) = convert_i16_to_f32_windowed_scalar;
+global void (*compute_magnitudes)(const f32* bins, f32* magnitudes, u32 count)                     = compute_magnitudes_scalar;
+global void (*magnitudes_to_decibels)(const f32* magnitudes, f32* decibels, u32 count, f32 offset) = magnitudes_to_decibels_scalar;
+global void (*multiply_f32)(const f32* a, const f32* b, f32* dst, u32 count)                       = multiply_f32_scalar;
+global f32  (*dot_product_f32)(const f32* a, const f32* b, u32 count)                              = dot_product_f32_scalar;
+global void (*goertzel_f32)(const f32* input, u32 count, const f32* coefficients, f32* s1, f32* s2, u32 tone_count) = goertzel_f32_scalar;
+global f64  (*biquad_cascade_energy_i16)(const i16* input, u32 count, const BiquadCascade* cascade, f32* state)    = biquad_cascade_energy_i16_scalar;
+global f32  (*true_peak_i16)(const i16* input, u32 count, const f32* taps)                                         = true_peak_i16_scalar;
+
+void init_simd()
+{
+	s_simd_level = detect_simd_level();
+	switch(s_simd_level) {
+		case SIMD_SSE2: {
+			convert_i16_to_f32_windowed = convert_i16_to_f32_windowed_sse2;
+			compute_magnitudes          = compute_magnitudes_sse2;
+			magnitudes_to_decibels      = magnitudes_to_decibels_sse2;
+			multiply_f32                = multiply_f32_sse2;
+			dot_product_f32             = dot_product_f32_sse2;
+			goertzel_f32                = goertzel_f32_sse2;
+			biquad_cascade_energy_i16   = biquad_cascade_energy_i16_sse2;
+			true_peak_i16               = true_peak_i16_sse2;
+		} break;
+
+		case SIMD_AVX2: {
+			convert_i16_to_f32_windowed = convert_i16_to_f32_windowed_avx2;
+			compute_magnitudes          = compute_magnitudes_avx2;
+			magnitudes_to_decibels      = magnitudes_to_decibels_avx2;
+			multiply_f32                = multiply_f32_avx2;
+			dot_product_f32             = dot_product_f32_avx2;
+			goertzel_f32                = goertzel_f32_avx2;
+			biquad_cascade_energy_i16   = biquad_cascade_energy_i16_avx2;
+			true_peak_i16               = true_peak_i16_avx2;
+		} break;
+	}
+}
@@ -0,0 +1,152 @@
+#pragma once
+#include <math.h>
+#include "basetypes.h"
+
+///////////////////////////////////////////////////////////
+//              Short Time Fourier Transform             //
+///////////////////////////////////////////////////////////
+
+enum WindowFunction : u32 {
+	WINDOW_HANN,
+	WINDOW_BLACKMAN_HARRIS,
+	WINDOW_FLAT_TOP,
+	WINDOW_KAISER,
+
+	WINDOW_FUNCTION_COUNT,
+};
+
+global const char* s_window_function_names[WINDOW_FUNCTION_COUNT] = { "hann", "blackman-harris", "flat-top", "kaiser" };
+
+global const f64 PI          = 3.14159265358979323846;
+global const f64 KAISER_BETA = 9.0;
+
+// most frames one device may get per analysis round, if more hops are pending the oldest ones get skipped
+global const u32 MAX_FRAMES_PER_ROUND = 16;
+
+//NOTE: per device hop scheduler, all positions are in samples since capture start. Every hop of captured audio gets exactly one
+// frame, frames of hops that became due while the previous round was still running are coalesced into one job. Frames end on
+// multiples of the hop, so frames of different devices that cover the same samples end at the same position whatever rounds
+// each of them took part in.
+struct StftState {
+	u64 consumed;        // end of the last frame that was handed to a job
+	u64 first_frame_end; // frames of the current round end at first_frame_end + i * hop
+	u32 frame_count;     // frames in the current round, 0 if the device isn't part of it
+	u32 hop;
+
+	u64 frames_computed;
+	u64 frames_skipped;
+	u64 frames_coalesced;
+};
+
+// hop between two consecutive frames in samples
+global ConfigValue    s_stft_hop = {
+	.min     = 256,
+	.current = 1024,
+	.max     = 4096,
+};
+global WindowFunction s_window_function = WINDOW_HANN;
+
+// returns the number of frames that are due for this device
+u32 schedule_frames(StftState* stft, u64 samples_captured, u32 fft_size, u32 hop)
+{
+	// the first frame needs a full window of samples
+	if(stft->consumed + hop < fft_size) stft->consumed = fft_size - hop;
+	// back onto the grid after the hop grew, the next frame still ends past the last one
+	stft->consumed -= stft->consumed % hop;
+
+	stft->frame_count = 0;
+	if(samples_captured < stft->consumed + hop) return 0;
+
+	u64 pending = (samples_captured - stft->consumed) / hop;
+	if(pending > MAX_FRAMES_PER_ROUND) {
+		stft->frames_skipped += pending - MAX_FRAMES_PER_ROUND;
+		stft->consumed       += (pending - MAX_FRAMES_PER_ROUND) * hop;
+		pending = MAX_FRAMES_PER_ROUND;
+	}
+
+	stft->hop               = hop;
+	stft->first_frame_end   = stft->consumed + hop;
+	stft->frame_count       = (u32)pending;
+	stft->consumed         += pending * hop;
+	stft->frames_computed  += pending;
+	stft->frames_coalesced += pending - 1;
+	return stft->frame_count;
+}
+
+u64 frame_end(StftState* stft, u32 frame)
+{
+	return stft->first_frame_end + (u64)frame * stft->hop;
+}
+
+//NOTE: the frames of a round that end at the same position on every device. Those are consecutive on every device and start
+// at the latest first frame, `first_frames` gets each device's index of it. Returns how many there are, 0 if some device's
+// frames all end before that.
+u32 pair_frames(StftState* states, u32 device_count, u32* first_frames)
+{
+	u64 first_end = 0;
+	for(u32 d = 0; d < device_count; d++) first_end = max(first_end, states[d].first_frame_end);
+
+	u32 paired = MAX_FRAMES_PER_ROUND;
+	for(u32 d = 0; d < device_count; d++) {
+		StftState& stft = states[d];
+		first_frames[d] = (u32)min((first_end - stft.first_frame_end) / stft.hop, (u64)stft.frame_count);
+		paired = min(paired, stft.frame_count - first_frames[d]);
+	}
+	return paired;
+}
+
+// zeroth order modified bessel function of the first kind, only used to build the kaiser window
+f64 bessel_i0(f64 x)
+{
+	f64 sum  = 1;
+	f64 term = 1;
+	for(u32 k = 1; k < 50; k++) {
+		f64 f = x / (2 * k);
+		term *= f * f;
+		sum  += term;
+		if(term < sum * 1e-17) break;
+	}
+	return sum;
+}
+
+//NOTE: windows are 'periodic' (denominator n instead of n - 1) since they get applied to consecutive fft frames
+void fill_window(WindowFunction function, f32* window, u32 n)
+{
+	for(u32 i = 0; i < n; i++) {
+		f64 p = 2 * PI * i / n;
+		switch(function) {
+			case WINDOW_HANN: {
+				window[i] = 0.5 - 0.5 * cos(p);
+			} break;
+
+			case WINDOW_BLACKMAN_HARRIS: {
+				window[i] = 0.35875 - 0.48829 * cos(p) + 0.14128 * cos(2 * p) - 0.01168 * cos(3 * p);
+			} break;
+
+			case WINDOW_FLAT_TOP: {
+				window[i] = 0.21557895 - 0.41663158 * cos(p) + 0.277263158 * cos(2 * p) - 0.083578947 * cos(3 * p) + 0.006947368 * cos(4 * p);
+			} break;
+
+			case WINDOW_KAISER: {
+				f64 r = 2.0 * i / n - 1;
+				window[i] = bessel_i0(KAISER_BETA * sqrt(1 - r * r)) / bessel_i0(KAISER_BETA);
+			} break;
+		}
+	}
+}
+
+// coherent gain of a window, spectra get divided by this to make them comparable between windows and sizes
+f64 window_sum(f32* window, u32 n)
+{
+	f64 sum = 0;
+	for(u32 i = 0; i < n; i++) sum += window[i];
+	return sum;
+}
+
+// incoherent power gain of a window, what power spectral densities get divided by
+f64 window_power(f32* window, u32 n)
+{
+	f64 sum = 0;
+	for(u32 i = 0; i < n; i++) sum += (f64)window[i] * window[i];
+	return sum;
+}
@@ -4,6 +4,7 @@
 #include "stb_truetype.h"
 #include "platform.h"
 #include "platform_win32.cpp"
+#include "format.cpp"
 
 struct CharacterData {
 	char character;
@@ -89,59 +90,3 @@ void render_text(Win32Buffer* buffer, u32 x, u32 y, s8 text)
 		x_offset += c.w;
 	}
 }
-
-global char s_characters_lut[] = { '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F' };
-
-s8 do_format(s8 format, s8 dst, va_list args)
-{
-	u32 dst_pos = 0;
-	u32 format_pos = 0;
-	while(dst_pos < dst.length && format_pos < format.length) {
-		if(format.data[format_pos] == '%') {
-			format_pos++;
-			switch(format.data[format_pos]) {
-				case 'd': {
-					i32 arg = va_arg(args, i32);
-					i32 mod = 10;
-					i32 digits_required = 1;
-					while(arg >= mod) {
-						digits_required++;
-						mod *= 10;
-					}
-					i32 write_offset = digits_required;
-					do {
-						dst.data[dst_pos + --write_offset] = s_characters_lut[arg % 10];
-						arg /= 10;
-					} while(write_offset > 0);
-					dst_pos += digits_required;
-				} break;
-
-				case '%': {
-					dst.data[dst_pos++] = '%';
-				} break;
-
-				default: {
-					char tmp[2] = { format.data[format_pos] };
-					OutputDebugString("unknown format option '");
-					OutputDebugString(tmp);
-					OutputDebugString("'\n");
-				} break;
-			}
-			format_pos++;
-		}
-		else {
-			dst.data[dst_pos++] = format.data[format_pos++];
-		}
-	}
-
-	dst.length = dst_pos;
-	return dst;
-}
-s8 format(s8 format, s8 dst, ...)
-{
-	va_list args;
-	va_start(args, dst);
-	s8 result = do_format(format, dst, args);
-	va_end(args);
-	return result;
-}
@@ -0,0 +1,188 @@
+#pragma once
+#include <atomic>
+#include <math.h>
+#include <stdlib.h>
+#include "basetypes.h"
+#include "platform.h"
+#include "stft.cpp"
+#include "simd.cpp"
+
+///////////////////////////////////////////////////////////
+//                      Tone Tracker                     //
+///////////////////////////////////////////////////////////
+
+//NOTE: levels of a few selected frequencies (mains hum, pilot tones) straight from the captured stream. Every device runs a bank
+// of goertzel resonators on hann windowed blocks of block_size samples, TONE_PHASES staggered blocks at a time, so a new level
+// arrives every block_size / TONE_PHASES samples. This runs on the capture thread right as the samples come in, independent of
+// the analysis rounds. Per sample it costs a multiply and two adds per tone and phase, vectorized across tones.
+//
+// The ui thread never touches the configuration the capture thread reads: it writes the other one of two and bumps
+// s_tone_generation, and only does so again once the capture thread reported that it moved on to the new one.
+global const u32 MAX_TONES      = 64; // multiple of 8 so the avx2 kernel covers the whole bank
+global const u32 TONE_PHASES    = 4;
+global const u32 TONE_MAX_BLOCK = 32768;
+global const u32 TONE_CHUNK     = 1024; // samples converted at once, captures can be much larger after a stall
+
+struct ToneConfig {
+	u32  tone_count;
+	u32  block_size; // power of two
+	f32  frequencies[MAX_TONES];
+	f32  coefficients[MAX_TONES]; // 2 cos(omega), unused ones stay 0
+	f32* window;
+	f64  window_sum;
+};
+
+struct TonePhase {
+	f32  s1[MAX_TONES];
+	f32  s2[MAX_TONES];
+	bool complete; // the current block started after the last reset
+};
+
+struct ToneBank {
+	u32              generation;
+	u64              position; // samples seen since capture start
+	TonePhase        phases[TONE_PHASES];
+	f32              chunk[TONE_CHUNK];
+	// published for the ui thread
+	std::atomic<f32> levels[MAX_TONES]; // amplitude / 2 like the linear spectrum
+	std::atomic<u32> levels_generation;
+};
+
+global ToneConfig       s_tone_configs[2];
+global std::atomic<u32> s_tone_generation;      // the active configuration is s_tone_configs[generation & 1]
+global std::atomic<u32> s_tone_generation_seen; // last generation the capture thread finished a pass with
+
+// the ui side's wish, gets published once the capture thread is ready for it
+global f32         s_tone_frequencies[MAX_TONES];
+global u32         s_tone_count;
+global bool        s_tones_dirty;
+global ConfigValue s_tone_block = {
+	.min     = 256,
+	.current = 2048,
+	.max     = TONE_MAX_BLOCK,
+};
+
+void allocate_tone_configs()
+{
+	for(u32 i = 0; i < 2; i++) {
+		s_tone_configs[i].window = (f32*)r_allocate(TONE_MAX_BLOCK * sizeof(f32));
+	}
+}
+
+void add_tone(f32 frequency)
+{
+	if(s_tone_count == MAX_TONES || frequency <= 0) return;
+	s_tone_frequencies[s_tone_count++] = frequency;
+	s_tones_dirty = true;
+}
+
+void clear_tones()
+{
+	s_tone_count  = 0;
+	s_tones_dirty = true;
+}
+
+// -tones 50,100,19000
+void parse_tone_options(char* command_line)
+{
+	char* list = strstr(command_line, "-tones ");
+	if(!list) return;
+	list += sizeof("-tones ") - 1;
+	while(true) {
+		char* end;
+		f32 frequency = strtof(list, &end);
+		if(end == list) break;
+		add_tone(frequency);
+		if(*end != ',') break;
+		list = end + 1;
+	}
+}
+
+//NOTE: ui thread, returns false while the capture thread still runs on the previous change, the caller tries again later
+bool publish_tone_config(u32 sample_rate)
+{
+	u32 generation = s_tone_generation.load(std::memory_order_relaxed);
+	if(s_tone_generation_seen.load(std::memory_order_acquire) != generation) return false;
+
+	ToneConfig& current = s_tone_configs[generation & 1];
+	ToneConfig& next    = s_tone_configs[(generation + 1) & 1];
+	next.tone_count = s_tone_count;
+	next.block_size = (u32)s_tone_block.current;
+	for(u32 t = 0; t < MAX_TONES; t++) {
+		next.frequencies[t]  = t < s_tone_count ? s_tone_frequencies[t] : 0;
+		next.coefficients[t] = t < s_tone_count ? (f32)(2 * cos(2 * PI * s_tone_frequencies[t] / sample_rate)) : 0;
+	}
+	// the window slot might be stale even with an unchanged size, it was last written two generations ago
+	fill_window(WINDOW_HANN, next.window, next.block_size);
+	next.window_sum = window_sum(next.window, next.block_size);
+
+	s_tone_generation.store(generation + 1, std::memory_order_release);
+	return true;
+}
+
+// capture thread, the returned configuration stays valid until release_tone_config
+ToneConfig* acquire_tone_config(u32* generation)
+{
+	*generation = s_tone_generation.load(std::memory_order_acquire);
+	return &s_tone_configs[*generation & 1];
+}
+
+void release_tone_config(u32 generation)
+{
+	s_tone_generation_seen.store(generation, std::memory_order_release);
+}
+
+void reset_tone_bank(ToneBank* bank, u32 generation)
+{
+	bank->generation = generation;
+	for(u32 p = 0; p < TONE_PHASES; p++) {
+		memset(bank->phases[p].s1, 0, sizeof(bank->phases[p].s1));
+		memset(bank->phases[p].s2, 0, sizeof(bank->phases[p].s2));
+		bank->phases[p].complete = false;
+	}
+	for(u32 t = 0; t < MAX_TONES; t++) bank->levels[t].store(0, std::memory_order_relaxed);
+}
+
+// |X|^2 = s1^2 + s2^2 - c s1 s2 holds for any omega, not just bin frequencies
+void finish_tone_block(ToneBank* bank, ToneConfig* config, u32 generation, TonePhase* phase)
+{
+	if(phase->complete) {
+		for(u32 t = 0; t < config->tone_count; t++) {
+			f32 a = phase->s1[t];
+			f32 b = phase->s2[t];
+			f32 power = a * a + b * b - config->coefficients[t] * a * b;
+			bank->levels[t].store(sqrtf(max(power, 0.0f)) / (f32)config->window_sum, std::memory_order_relaxed);
+		}
+		bank->levels_generation.store(generation, std::memory_order_release);
+	}
+	memset(phase->s1, 0, sizeof(phase->s1));
+	memset(phase->s2, 0, sizeof(phase->s2));
+	phase->complete = true;
+}
+
+void process_tones(ToneBank* bank, ToneConfig* config, u32 generation, const i16* samples, u32 count)
+{
+	if(bank->generation != generation) reset_tone_bank(bank, generation);
+	if(!config->tone_count) {
+		bank->position += count;
+		return;
+	}
+
+	// only whole vectors of tones, the padding has a coefficient of 0 and never gets published
+	u32 tone_count = (config->tone_count + 7) & ~7u;
+	u32 block_mask = config->block_size - 1;
+	u32 stagger    = config->block_size / TONE_PHASES;
+	for(u32 p = 0; p < TONE_PHASES; p++) {
+		TonePhase& phase = bank->phases[p];
+		for(u32 done = 0; done < count;) {
+			// every phase's blocks start at multiples of block_size, offset by its stagger
+			u32 offset = (u32)((bank->position + done + p * stagger) & block_mask);
+			u32 length = min(min(count - done, config->block_size - offset), TONE_CHUNK);
+			convert_i16_to_f32_windowed(samples + done, config->window + offset, bank->chunk, length);
+			goertzel_f32(bank->chunk, length, config->coefficients, phase.s1, phase.s2, tone_count);
+			done += length;
+			if(offset + length == config->block_size) finish_tone_block(bank, config, generation, &phase);
+		}
+	}
+	bank->position += count;
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include <assert.h>
+#include <atomic>
+#include "basetypes.h"
+#include "platform.h"
+
+///////////////////////////////////////////////////////////
+//                      Worker Pool                      //
+///////////////////////////////////////////////////////////
+
+struct Job;
+typedef void JobFunction(Job* job);
+
+struct Job {
+	JobFunction* function;
+	u32          device;
+	u32          sequence;
+};
+
+//NOTE: fixed size queue with a single submitting thread and any number of workers. Workers claim entries by bumping next_read,
+// the submitter only ever adds up to WORK_QUEUE_SIZE jobs between two points where the queue is finished, so entries are never
+// overwritten while a worker still copies them out.
+global const u32 WORK_QUEUE_SIZE = 64;
+
+struct WorkQueue {
+	Job              entries[WORK_QUEUE_SIZE];
+	std::atomic<u32> next_write;
+	std::atomic<u32> next_read;
+	std::atomic<u32> completed;
+	u32              submitted; // only touched by the submitting thread
+	u32              worker_count;
+	void*            semaphore;
+};
+
+global WorkQueue s_work_queue;
+
+void submit_job(WorkQueue* queue, JobFunction* function, u32 device, u32 sequence)
+{
+	u32 write = queue->next_write.load(std::memory_order_relaxed);
+	assert(write - queue->completed.load(std::memory_order_relaxed) < WORK_QUEUE_SIZE);
+
+	queue->entries[write % WORK_QUEUE_SIZE] = { .function = function, .device = device, .sequence = sequence };
+	queue->next_write.store(write + 1, std::memory_order_release);
+	queue->submitted++;
+	signal_semaphore(queue->semaphore, 1);
+}
+
+// true once every submitted job ran, everything the jobs wrote is visible to the submitter afterwards
+bool work_queue_finished(WorkQueue* queue)
+{
+	return queue->completed.load(std::memory_order_acquire) == queue->submitted;
+}
+
+// returns false if there was nothing to do
+bool run_next_job(WorkQueue* queue)
+{
+	u32 read = queue->next_read.load(std::memory_order_relaxed);
+	if(read == queue->next_write.load(std::memory_order_acquire)) return false;
+
+	if(queue->next_read.compare_exchange_weak(read, read + 1, std::memory_order_acquire)) {
+		Job job = queue->entries[read % WORK_QUEUE_SIZE];
+		job.function(&job);
+		queue->completed.fetch_add(1, std::memory_order_release);
+	}
+	return true;
+}
+
+void worker_thread(void* data)
+{
+	WorkQueue* queue = (WorkQueue*)data;
+	for(;;) {
+		if(!run_next_job(queue)) wait_semaphore(queue->semaphore);
+	}
+}
+
+// one worker per core besides the ui thread
+void start_workers(WorkQueue* queue)
+{
+	queue->worker_count = max(get_processor_count() - 1, 1u);
+	queue->semaphore    = create_semaphore();
+	for(u32 i = 0; i < queue->worker_count; i++) {
+		start_thread(worker_thread, queue);
+	}
+}
@@ -0,0 +1,204 @@
+#pragma once
+#include <math.h>
+#include "basetypes.h"
+#include "platform.h"
+#include "stft.cpp"
+#include "fft.cpp"
+#include "simd.cpp"
+#include "sample_ring.cpp"
+
+///////////////////////////////////////////////////////////
+//                       Zoom FFT                        //
+///////////////////////////////////////////////////////////
+
+//NOTE: high resolution spectrum of a narrow band. Every device's samples get mixed down by the band center (complex heterodyne),
+// low pass filtered and decimated, and the last ZOOM_FFT_SIZE decimated samples go through a complex fft. That resolves
+// sample_rate / (decimation * ZOOM_FFT_SIZE) Hz, like a plain fft decimation times larger, at a fraction of the cost.
+// The mixer and filter run on the sample stream, so they keep state per device and only ever see every sample once.
+global const u32 ZOOM_FFT_SIZE        = MAX_ZOOM_BINS;
+global const u32 ZOOM_MAX_DECIMATION  = 128;
+global const u32 ZOOM_TAPS_PER_FACTOR = 17;   // filter taps per decimation step, enough for a transition of a third of the output rate
+global const u32 ZOOM_HISTORY_SIZE    = 4096; // power of two >= the longest filter
+global const f64 ZOOM_OVERSAMPLING    = 1.5;  // decimated rate / band width, the excess is the filter's transition band
+
+// shared configuration, only changed by the ui thread between rounds
+struct ZoomConfig {
+	bool           active;
+	f32            band_min;
+	f32            band_max;
+	f32            center;
+	u32            decimation;
+	u32            tap_count;
+	f32*           taps;
+	WindowFunction window_function;
+	f32*           window;
+	f64            window_sum;
+	fftwf_plan     plan;
+	u32            generation; // bumped whenever the filter or mixer changes, device states reset on a mismatch
+};
+
+struct ZoomState {
+	u32            generation;
+	u64            position;        // next input sample
+	f64            oscillator_re;
+	f64            oscillator_im;
+	f32*           history;         // 2 * ZOOM_HISTORY_SIZE complex, every sample is stored twice so the filter input is contiguous
+	fftwf_complex* decimated;       // ring of the last ZOOM_FFT_SIZE filter outputs
+	u64            decimated_count;
+	fftwf_complex* in;
+	fftwf_complex* out;
+};
+
+global ZoomConfig s_zoom;
+
+f32 zoom_bin_width(u32 sample_rate)
+{
+	return (f32)sample_rate / (s_zoom.decimation * ZOOM_FFT_SIZE);
+}
+
+// frequency of the first bin of a zoomed spectrum, bins are stored lowest frequency first
+f32 zoom_frequency_min(u32 sample_rate)
+{
+	return s_zoom.center - ZOOM_FFT_SIZE / 2 * zoom_bin_width(sample_rate);
+}
+
+//NOTE: the plan gets created on the first device's buffers and is executed on every device's with fftwf_execute_dft, they are
+// all allocated by fftw so the alignment matches. Planning may overwrite the buffers, so this has to run before they get filled.
+void create_zoom_plan(ZoomState* states, u32 device_count)
+{
+	s_zoom.taps   = (f32*)r_allocate((ZOOM_TAPS_PER_FACTOR * ZOOM_MAX_DECIMATION + 1) * sizeof(f32));
+	s_zoom.window = (f32*)r_allocate(ZOOM_FFT_SIZE * sizeof(f32));
+	s_zoom.window_function = WINDOW_FUNCTION_COUNT;
+
+	for(u32 d = 0; d < device_count; d++) {
+		states[d].history   = (f32*)r_allocate(ZOOM_HISTORY_SIZE * 2 * 2 * sizeof(f32));
+		states[d].decimated = fftwf_alloc_complex(ZOOM_FFT_SIZE);
+		states[d].in        = fftwf_alloc_complex(ZOOM_FFT_SIZE);
+		states[d].out       = fftwf_alloc_complex(ZOOM_FFT_SIZE);
+	}
+	if(!device_count) return;
+
+	f64 start = get_seconds();
+	s_zoom.plan = fftwf_plan_dft_1d(ZOOM_FFT_SIZE, states[0].in, states[0].out, FFTW_FORWARD, s_plan_quality_flags[s_plan_quality]);
+	s_plan_report.plans_created++;
+	s_plan_report.planning_seconds += get_seconds() - start;
+}
+
+//NOTE: zooming kicks in once it resolves at least twice as fine as the plain fft. The decimation is the largest one that keeps
+// the band inside the decimated rate with ZOOM_OVERSAMPLING to spare.
+void configure_zoom(bool allowed, u32 sample_rate, u32 fft_size, WindowFunction window_function, f32 band_min, f32 band_max)
+{
+	if(window_function != s_zoom.window_function) {
+		s_zoom.window_function = window_function;
+		fill_window(window_function, s_zoom.window, ZOOM_FFT_SIZE);
+		s_zoom.window_sum = window_sum(s_zoom.window, ZOOM_FFT_SIZE);
+	}
+
+	u32 decimation = (u32)min(sample_rate / (ZOOM_OVERSAMPLING * max(band_max - band_min, 1.0f)), (f64)ZOOM_MAX_DECIMATION);
+	s_zoom.active = allowed && decimation * ZOOM_FFT_SIZE >= 2 * fft_size;
+	if(!s_zoom.active) return;
+
+	f32 center = (band_min + band_max) / 2;
+	if(decimation == s_zoom.decimation && center == s_zoom.center) {
+		s_zoom.band_min = band_min;
+		s_zoom.band_max = band_max;
+		return;
+	}
+	s_zoom.band_min   = band_min;
+	s_zoom.band_max   = band_max;
+	s_zoom.center     = center;
+	s_zoom.decimation = decimation;
+	s_zoom.generation++;
+
+	// blackman windowed sinc with its cutoff at half the decimated rate, unity gain at dc
+	u32 tap_count = ZOOM_TAPS_PER_FACTOR * decimation + 1;
+	f64 cutoff    = 0.5 / decimation;
+	f64 sum       = 0;
+	for(u32 t = 0; t < tap_count; t++) {
+		f64 x = t - (tap_count - 1) / 2.0;
+		f64 sinc = x == 0 ? 2 * cutoff : sin(2 * PI * cutoff * x) / (PI * x);
+		f64 p = 2 * PI * t / (tap_count - 1);
+		s_zoom.taps[t] = sinc * (0.42 - 0.5 * cos(p) + 0.08 * cos(2 * p));
+		sum += s_zoom.taps[t];
+	}
+	for(u32 t = 0; t < tap_count; t++) s_zoom.taps[t] /= sum;
+	s_zoom.tap_count = tap_count;
+}
+
+void reset_zoom_state(ZoomState* state, u64 position)
+{
+	state->generation      = s_zoom.generation;
+	state->position        = position;
+	state->oscillator_re   = 1;
+	state->oscillator_im   = 0;
+	state->decimated_count = 0;
+	memset(state->history, 0, ZOOM_HISTORY_SIZE * 2 * 2 * sizeof(f32));
+	memset(state->decimated, 0, ZOOM_FFT_SIZE * sizeof(fftwf_complex));
+}
+
+void mix_and_decimate(ZoomState* state, const i16* samples, u32 count, u32 sample_rate)
+{
+	f64 step_re = cos(-2 * PI * s_zoom.center / sample_rate);
+	f64 step_im = sin(-2 * PI * s_zoom.center / sample_rate);
+	u32 mask    = ZOOM_HISTORY_SIZE - 1;
+	for(u32 i = 0; i < count; i++) {
+		u64 position = state->position++;
+		f32 re = (f32)(samples[i] * state->oscillator_re);
+		f32 im = (f32)(samples[i] * state->oscillator_im);
+		u32 slot = position & mask;
+		state->history[slot * 2 + 0] = state->history[(slot + ZOOM_HISTORY_SIZE) * 2 + 0] = re;
+		state->history[slot * 2 + 1] = state->history[(slot + ZOOM_HISTORY_SIZE) * 2 + 1] = im;
+
+		f64 next_re = state->oscillator_re * step_re - state->oscillator_im * step_im;
+		f64 next_im = state->oscillator_re * step_im + state->oscillator_im * step_re;
+		state->oscillator_re = next_re;
+		state->oscillator_im = next_im;
+
+		// outputs sit at multiples of the decimation in absolute sample positions, so they don't depend on round boundaries
+		if((position + 1) % s_zoom.decimation) continue;
+
+		// the oscillator drifts off the unit circle over time, pulling it back once per output is plenty
+		f64 length = sqrt(state->oscillator_re * state->oscillator_re + state->oscillator_im * state->oscillator_im);
+		state->oscillator_re /= length;
+		state->oscillator_im /= length;
+
+		// taps are symmetric, so the newest sample meeting the first tap is the same as the convolution
+		const f32* x = state->history + (slot + ZOOM_HISTORY_SIZE + 1 - s_zoom.tap_count) * 2;
+		f32 sum_re = 0, sum_im = 0;
+		for(u32 t = 0; t < s_zoom.tap_count; t++) {
+			sum_re += x[t * 2 + 0] * s_zoom.taps[t];
+			sum_im += x[t * 2 + 1] * s_zoom.taps[t];
+		}
+		fftwf_complex& out = state->decimated[state->decimated_count++ % ZOOM_FFT_SIZE];
+		out[0] = sum_re;
+		out[1] = sum_im;
+	}
+}
+
+//NOTE: brings the device's decimator up to `frame_end` and transforms the newest ZOOM_FFT_SIZE outputs. `magnitudes` gets
+// ZOOM_FFT_SIZE bins, lowest frequency first. A state that is out of date or fell behind what the ring still holds starts
+// over MAX_FFT_SIZE samples before the frame, the ring always keeps that much.
+void zoom_frame(ZoomState* zoom_state, SampleRing* ring, u64 frame_end, u32 sample_rate, f32* magnitudes)
+{
+	ZoomState& state = *zoom_state;
+	bool stale = state.position < ring->read_count.load(std::memory_order_relaxed) || state.position > frame_end;
+	if(state.generation != s_zoom.generation || stale) {
+		reset_zoom_state(&state, frame_end - min(frame_end, (u64)MAX_FFT_SIZE));
+	}
+
+	RingSpan span = ring_span(ring, state.position, (u32)(frame_end - state.position));
+	mix_and_decimate(&state, span.first, span.first_length, sample_rate);
+	mix_and_decimate(&state, span.second, span.second_length, sample_rate);
+
+	for(u32 i = 0; i < ZOOM_FFT_SIZE; i++) {
+		fftwf_complex& sample = state.decimated[(state.decimated_count + i) % ZOOM_FFT_SIZE];
+		state.in[i][0] = sample[0] * s_zoom.window[i];
+		state.in[i][1] = sample[1] * s_zoom.window[i];
+	}
+	fftwf_execute_dft(s_zoom.plan, state.in, state.out);
+
+	// negative frequencies are in the upper half of the output
+	u32 half = ZOOM_FFT_SIZE / 2;
+	compute_magnitudes((f32*)(state.out + half), magnitudes, half);
+	compute_magnitudes((f32*)state.out, magnitudes + half, half);
+}
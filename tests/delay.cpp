@@ -0,0 +1,150 @@
+#include <stdlib.h>
+#include "test.h"
+#include "../src/delay.cpp"
+#include "../src/sample_ring.cpp"
+#include "../src/simd.cpp"
+
+//NOTE: two devices picking up the same white noise, the second one DELAY samples later through a windowed sinc fractional delay
+// and with a bit of noise of its own. Their captures arrive in different chunk sizes like two sound cards with different buffer
+// sizes, so rounds where both are due start at different frames on each device. Frames get paired with pair_frames like the batched job does, the averaged
+// cross spectra have to show the delay within MAX_DELAY_ERROR samples with a high confidence, and a coherent, flat transfer
+// function below the band edge of the fractional delay. Coherence and transfer are checked on single bins, a wide column sums
+// bins the delay turned in different directions.
+global const u32 SAMPLE_RATE        = 44100;
+global const u32 DEVICE_COUNT       = 2;
+global const u32 FFT_SIZE_INDEX     = 2;
+global const u32 HOP                = 1024;
+global const f64 DELAY              = 37.3; // samples
+global const u32 TEST_SECONDS       = 3;
+global const u32 CHUNKS[DEVICE_COUNT] = { 441, 1323 }; // samples each device's capture delivers at once
+global const f64 SIGNAL_AMPLITUDE   = 3000;
+global const f64 NOISE_AMPLITUDE    = 20;
+global const u32 DELAY_TAPS         = 127; // of the fractional part
+global const u32 SIGNAL_SAMPLES     = TEST_SECONDS * SAMPLE_RATE + DELAY_TAPS + 64;
+global const f32 MAX_DELAY_ERROR    = 0.1f;
+global const f32 MIN_CONFIDENCE     = 0.5f;
+global const f32 MIN_COHERENCE      = 0.9f;
+global const f32 MAX_TRANSFER_DB    = 0.5f;
+
+global SampleRing      s_rings[DEVICE_COUNT];
+global StftState       s_stft[DEVICE_COUNT];
+global CrossSpectrum   s_cross_spectra[DEVICE_COUNT];
+global DelayState      s_delay_states[DEVICE_COUNT];
+global SpectrumBuffers s_buffers;
+
+global f64* s_signal;  // white noise
+global f64* s_delayed; // s_signal DELAY samples later
+
+f64 random_unit()
+{
+	return (f64)rand() / RAND_MAX;
+}
+
+// hann windowed sinc, flat within 0.1 dB up to about 18 kHz at 44.1 kHz
+void generate_signals()
+{
+	s_signal  = (f64*)r_allocate(SIGNAL_SAMPLES * sizeof(f64));
+	s_delayed = (f64*)r_allocate(SIGNAL_SAMPLES * sizeof(f64));
+	for(u32 n = 0; n < SIGNAL_SAMPLES; n++) s_signal[n] = SIGNAL_AMPLITUDE * (2 * random_unit() - 1);
+
+	u32 whole = (u32)DELAY;
+	f64 fraction = DELAY - whole;
+	i32 half = DELAY_TAPS / 2;
+	f64 taps[DELAY_TAPS];
+	for(i32 i = 0; i < (i32)DELAY_TAPS; i++) {
+		f64 x = i - half - fraction;
+		f64 sinc = fabs(x) < 1e-12 ? 1 : sin(PI * x) / (PI * x);
+		taps[i] = sinc * (0.5 + 0.5 * cos(PI * x / (half + 1)));
+	}
+	for(u32 n = whole + DELAY_TAPS; n < SIGNAL_SAMPLES; n++) {
+		f64 value = 0;
+		for(u32 i = 0; i < DELAY_TAPS; i++) value += taps[i] * s_signal[n - whole + half - i];
+		s_delayed[n] = value;
+	}
+}
+
+// capture positions are offset so the delay filter is warmed up from the first sample on
+void capture(u32 d, u64 from, u64 to)
+{
+	i16 chunk[2048];
+	const f64* source = d ? s_delayed : s_signal;
+	for(u64 n = from; n < to; n++) {
+		chunk[n - from] = (i16)lrint(source[n + DELAY_TAPS + 64] + NOISE_AMPLITUDE * (2 * random_unit() - 1));
+	}
+	ring_write(&s_rings[d], chunk, (u32)(to - from));
+}
+
+void gather(u32 d, FFTPlan& plan, u32 frame)
+{
+	RingSpan span = ring_span(&s_rings[d], frame_end(&s_stft[d], frame) - plan.size, plan.size);
+	f32* in = fft_input(d, plan.size);
+	convert_i16_to_f32_windowed(span.first, plan.window, in, span.first_length);
+	convert_i16_to_f32_windowed(span.second, plan.window + span.first_length, in + span.first_length, span.second_length);
+}
+
+i32 main()
+{
+	init_simd();
+	create_fft_plans(DEVICE_COUNT);
+	create_delay_plans(s_delay_states, DEVICE_COUNT);
+	allocate_spectrum_buffers(&s_buffers);
+	for(u32 d = 0; d < DEVICE_COUNT; d++) {
+		ring_init(&s_rings[d], SAMPLE_RATE * 5);
+		allocate_cross_spectrum(&s_cross_spectra[d]);
+	}
+	srand(1);
+	generate_signals();
+
+	FFTPlan& plan = s_fft_plans[FFT_SIZE_INDEX];
+	CrossAverage average = {};
+	u32 batched_rounds = 0;
+	u32 shifted_rounds = 0;
+	u64 captured[DEVICE_COUNT] = {};
+	for(u64 time = CHUNKS[0]; time <= TEST_SECONDS * SAMPLE_RATE; time += CHUNKS[0]) {
+		u32 due_devices = 0;
+		for(u32 d = 0; d < DEVICE_COUNT; d++) {
+			u64 end = time - time % CHUNKS[d];
+			if(end > captured[d]) capture(d, captured[d], end);
+			captured[d] = end;
+			if(schedule_frames(&s_stft[d], ring_available(&s_rings[d]), plan.size, HOP)) due_devices++;
+		}
+
+		// like update(), only rounds where every device is due get batched, the others don't touch the cross spectra
+		if(due_devices == DEVICE_COUNT) {
+			batched_rounds++;
+			if(s_stft[0].first_frame_end != s_stft[1].first_frame_end) shifted_rounds++;
+
+			u32 first_frames[DEVICE_COUNT];
+			u32 paired_frames = pair_frames(s_stft, DEVICE_COUNT, first_frames);
+			for(u32 i = 0; i < paired_frames; i++) {
+				for(u32 d = 0; d < DEVICE_COUNT; d++) gather(d, plan, first_frames[d] + i);
+				check(frame_end(&s_stft[0], first_frames[0] + i) == frame_end(&s_stft[1], first_frames[1] + i), "paired frames end apart");
+				fftwf_execute(plan.batch_plan);
+				accumulate_cross_spectra(&average, s_cross_spectra, DEVICE_COUNT, 0, plan.size, 1);
+			}
+		}
+		for(u32 d = 0; d < DEVICE_COUNT; d++) {
+			if(s_stft[d].consumed > MAX_FFT_SIZE) ring_release(&s_rings[d], s_stft[d].consumed - MAX_FFT_SIZE);
+		}
+	}
+	printf("%d batched rounds, %d of them started at different frames\n", batched_rounds, shifted_rounds);
+	check(shifted_rounds > 0, "the devices never got out of step, the test doesn't cover pairing");
+
+	SpectrumSlot& slot = s_buffers.slots[0];
+	publish_cross(&average, s_cross_spectra, 1, slot);
+	check(slot.cross_valid, "no cross spectra after %d rounds", batched_rounds);
+	estimate_delay(&s_delay_states[1], slot, FFT_SIZE_INDEX, 1);
+	printf("delay %.3f samples (%.3f expected), confidence %.2f\n", slot.delay, DELAY, slot.delay_confidence);
+	check(fabs(slot.delay - DELAY) <= MAX_DELAY_ERROR, "delay %.3f instead of %.3f", slot.delay, DELAY);
+	check(slot.delay_confidence >= MIN_CONFIDENCE, "delay confidence %.2f", slot.delay_confidence);
+
+	// one bin per kHz up to the delay filter's band edge
+	f32 bin_width = (f32)SAMPLE_RATE / plan.size;
+	for(u32 khz = 1; khz <= 17; khz++) {
+		u32 bin = (u32)(khz * 1000 / bin_width);
+		CrossColumn column = cross_column(slot, bin, bin + 1);
+		check(column.coherence >= MIN_COHERENCE, "%d kHz: coherence %.3f", khz, column.coherence);
+		check(fabs(column.magnitude) <= MAX_TRANSFER_DB, "%d kHz: transfer %.2f dB", khz, column.magnitude);
+	}
+	return finish_test("delay");
+}
@@ -0,0 +1,89 @@
+#include "test.h"
+#include "../src/simd.cpp"
+
+//NOTE: sweeps the fast log over the whole positive float range against the double precision log and holds it to the bounds the
+// note above fast_log2 documents: 2e-6 in log2 for the series itself, which shows on the exponent 0 binade where nothing else
+// rounds, and 1e-4 dB for the decibel kernels everywhere else. Every mantissa of the exponent 0 binade gets checked, the rest
+// of the range with a stride through the float bits so every exponent sees a few hundred thousand mantissas.
+global const f64 SERIES_BOUND  = 2e-6;  // log2
+global const f64 DECIBEL_BOUND = 1e-4;  // dB
+global const u32 SWEEP_STRIDE  = 37;    // float bits, odd so the mantissas don't line up with the binades
+global const u32 BATCH         = 4096;
+
+typedef void (*DecibelKernel)(const f32* magnitudes, f32* decibels, u32 count, f32 offset);
+
+global const DecibelKernel s_decibel_kernels[SIMD_LEVEL_COUNT] = { magnitudes_to_decibels_scalar, magnitudes_to_decibels_sse2, magnitudes_to_decibels_avx2 };
+
+f32 float_from_bits(u32 bits)
+{
+	f32 x;
+	memcpy(&x, &bits, sizeof(x));
+	return x;
+}
+
+struct SweepResult {
+	f64 max_error;
+	f32 worst_input;
+};
+
+// max |decibels - 20 log10(x)| over [first_bits, last_bits) in steps of `stride`
+SweepResult sweep_decibels(DecibelKernel kernel, u32 first_bits, u32 last_bits, u32 stride)
+{
+	SweepResult result = {};
+	f32 inputs[BATCH];
+	f32 decibels[BATCH];
+	u64 bits = first_bits;
+	while(bits < last_bits) {
+		u32 count = 0;
+		for(; count < BATCH && bits < last_bits; count++, bits += stride) inputs[count] = float_from_bits((u32)bits);
+		kernel(inputs, decibels, count, 0);
+		for(u32 i = 0; i < count; i++) {
+			f64 error = fabs(decibels[i] - 20 * log10((f64)inputs[i]));
+			if(error > result.max_error) {
+				result.max_error   = error;
+				result.worst_input = inputs[i];
+			}
+		}
+	}
+	return result;
+}
+
+i32 main()
+{
+	// the series alone, every mantissa in [1, 2) folds through both branches of the fold at sqrt(2)
+	f64 series_error = 0;
+	f32 series_worst = 0;
+	for(u32 bits = 0x3f800000; bits < 0x40000000; bits++) {
+		f32 x = float_from_bits(bits);
+		f64 error = fabs(fast_log2(x) - log2((f64)x));
+		if(error > series_error) {
+			series_error = error;
+			series_worst = x;
+		}
+	}
+	printf("fast_log2 on [1, 2): max error %.3g at %.9g\n", series_error, series_worst);
+	check(series_error <= SERIES_BOUND, "log2 error %.3g above %.3g", series_error, SERIES_BOUND);
+
+	// the decibel kernels from FAST_LOG_MIN up to the largest finite float
+	u32 first_bits = 0;
+	memcpy(&first_bits, &FAST_LOG_MIN, sizeof(first_bits));
+	SimdLevel supported = detect_simd_level();
+	for(u32 level = 0; level <= supported; level++) {
+		SweepResult binade = sweep_decibels(s_decibel_kernels[level], 0x3f800000, 0x40000000, 1);
+		SweepResult range  = sweep_decibels(s_decibel_kernels[level], first_bits, 0x7f800000, SWEEP_STRIDE);
+		f64 error = max(binade.max_error, range.max_error);
+		f32 worst = binade.max_error > range.max_error ? binade.worst_input : range.worst_input;
+		printf("%-8s decibels: max error %.3g dB at %.9g\n", s_simd_level_names[level], error, worst);
+		check(error <= DECIBEL_BOUND, "%s: decibel error %.3g above %.3g", s_simd_level_names[level], error, DECIBEL_BOUND);
+
+		// below the clamp everything reads like FAST_LOG_MIN instead of running off to -inf
+		f32 silence[8] = { 0, 0, 1e-35f, 1e-38f, FAST_LOG_MIN, 0, 0, 0 };
+		f32 floor[8];
+		s_decibel_kernels[level](silence, floor, 8, 0);
+		f64 expected = 20 * log10((f64)FAST_LOG_MIN);
+		for(u32 i = 0; i < 8; i++) {
+			check(fabs(floor[i] - expected) <= DECIBEL_BOUND, "%s: %.9g reads %.9g dB, not the floor", s_simd_level_names[level], silence[i], floor[i]);
+		}
+	}
+	return finish_test("fast log");
+}
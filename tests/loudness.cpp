@@ -0,0 +1,135 @@
+#include "test.h"
+#include "../src/loudness.cpp"
+
+//NOTE: the meter against the bs.1770 reference values at 48 kHz and the 44.1 kHz the app runs at, for every simd level the cpu
+// supports: a full scale 997 Hz sine reads -3.01 LUFS, 1 kHz at -20 dBFS reads -23.0 LUFS, and 5 s of that followed by 5 s at
+// -50 dBFS integrates to about that since the relative gate drops the quiet part. True peak has to be within
+// MAX_TRUE_PEAK_ERROR of a sine's amplitude up to TRUE_PEAK_BAND of the rate. Then the cost on the capture thread, fed in
+// capture sized chunks.
+global const u32 SAMPLE_RATES[]      = { 48000, 44100 };
+global const u32 SAMPLE_RATE_COUNT   = sizeof(SAMPLE_RATES) / sizeof(SAMPLE_RATES[0]);
+global const u32 TEST_SECONDS        = 10;
+global const u32 CAPTURE_MS          = 10;
+global const u32 FADE_MS             = 10;
+global const f32 MAX_LOUDNESS_ERROR  = 0.05f; // LU
+global const f32 MAX_TRUE_PEAK_ERROR = 0.1f;  // dB
+global const f64 TRUE_PEAK_BAND      = 0.38;  // of the sample rate, see TRUE_PEAK_KAISER_BETA
+global const f64 TRUE_PEAK_AMPLITUDE = 16384; // -6.02 dBFS
+global const f64 COST_TARGET         = 1.0;   // percent of a core per device at 48 kHz
+
+global LoudnessMeter s_meter;
+
+void use_simd_level(u32 level)
+{
+	switch(level) {
+		case SIMD_SCALAR: {
+			biquad_cascade_energy_i16 = biquad_cascade_energy_i16_scalar;
+			true_peak_i16             = true_peak_i16_scalar;
+		} break;
+
+		case SIMD_SSE2: {
+			biquad_cascade_energy_i16 = biquad_cascade_energy_i16_sse2;
+			true_peak_i16             = true_peak_i16_sse2;
+		} break;
+
+		case SIMD_AVX2: {
+			biquad_cascade_energy_i16 = biquad_cascade_energy_i16_avx2;
+			true_peak_i16             = true_peak_i16_avx2;
+		} break;
+	}
+}
+
+// two sines one after the other, `split` seconds of the first. Faded in over FADE_MS, the meter's reset starts the true peak
+// filter from silence and a sine that starts abruptly rings in it.
+void fill_sines(i16* samples, u32 sample_rate, f64 frequency, f64 amplitude, f64 split, f64 second_amplitude, f64 phase)
+{
+	u32 count = TEST_SECONDS * sample_rate;
+	u32 fade  = sample_rate * FADE_MS / 1000;
+	for(u32 n = 0; n < count; n++) {
+		f64 a = n < split * sample_rate ? amplitude : second_amplitude;
+		if(n < fade) a *= 0.5 - 0.5 * cos(PI * n / fade);
+		samples[n] = (i16)lrint(min(a * sin(2 * PI * frequency * n / sample_rate + phase), 32767.0));
+	}
+}
+
+void meter(const i16* samples, u32 sample_rate)
+{
+	s_loudness_reset.fetch_add(1);
+	u32 count = TEST_SECONDS * sample_rate;
+	u32 chunk = sample_rate * CAPTURE_MS / 1000;
+	for(u32 done = 0; done < count; done += chunk) process_loudness(&s_meter, samples + done, min(chunk, count - done));
+}
+
+void check_loudness(const char* name, u32 sample_rate, f32 expected, bool steady)
+{
+	f32 integrated = s_meter.integrated.load();
+	printf("    %-24s M %7.2f  S %7.2f  I %7.2f LUFS (%.2f expected)\n", name, s_meter.momentary.load(), s_meter.short_term.load(), integrated, expected);
+	check(fabs(integrated - expected) <= MAX_LOUDNESS_ERROR, "%d Hz, %s: integrated %.2f LUFS", sample_rate, name, integrated);
+	if(steady) {
+		check(fabs(s_meter.momentary.load() - expected) <= MAX_LOUDNESS_ERROR, "%d Hz, %s: momentary %.2f LUFS", sample_rate, name, s_meter.momentary.load());
+		check(fabs(s_meter.short_term.load() - expected) <= MAX_LOUDNESS_ERROR, "%d Hz, %s: short term %.2f LUFS", sample_rate, name, s_meter.short_term.load());
+	}
+}
+
+i32 main()
+{
+	SimdLevel supported = detect_simd_level();
+	i16* samples = (i16*)r_allocate(TEST_SECONDS * 48000 * sizeof(i16));
+	f32 expected_peak = 20 * log10f((f32)(TRUE_PEAK_AMPLITUDE / 32768));
+
+	for(u32 r = 0; r < SAMPLE_RATE_COUNT; r++) {
+		u32 sample_rate = SAMPLE_RATES[r];
+		init_loudness(sample_rate);
+		for(u32 level = 0; level <= supported; level++) {
+			use_simd_level(level);
+			printf("%d Hz, %s\n", sample_rate, s_simd_level_names[level]);
+
+			fill_sines(samples, sample_rate, 997, 32767, TEST_SECONDS, 0, 0);
+			meter(samples, sample_rate);
+			check_loudness("997 Hz at 0 dBFS", sample_rate, -3.01f, true);
+
+			fill_sines(samples, sample_rate, 1000, 3276.7, TEST_SECONDS, 0, 0);
+			meter(samples, sample_rate);
+			check_loudness("1 kHz at -20 dBFS", sample_rate, -23.0f, true);
+
+			fill_sines(samples, sample_rate, 1000, 3276.7, TEST_SECONDS / 2, 103.6, 0);
+			meter(samples, sample_rate);
+			// the three blocks over the switch are 3/4, 1/2 and 1/4 loud and pass the relative gate too, 48.5 blocks worth of
+			// -23 LUFS over the 50 that do
+			check_loudness("-20 then -50 dBFS", sample_rate, -23.0f + 10 * log10f(48.5f / 50), false);
+
+			// frequencies off the sample grid so the sine's crests land on every phase over the test
+			f64 worst_error = 0, worst_frequency = 0;
+			for(f64 frequency = 1001.3; frequency <= TRUE_PEAK_BAND * sample_rate; frequency += 1499.7) {
+				fill_sines(samples, sample_rate, frequency, TRUE_PEAK_AMPLITUDE, TEST_SECONDS, 0, 0.3);
+				meter(samples, sample_rate);
+				f64 error = fabs(s_meter.true_peak_max.load() - expected_peak);
+				if(error > worst_error) {
+					worst_error     = error;
+					worst_frequency = frequency;
+				}
+			}
+			printf("    true peak up to %5d Hz: worst error %.3f dB at %d Hz\n", (i32)(TRUE_PEAK_BAND * sample_rate), worst_error, (i32)worst_frequency);
+			check(worst_error <= MAX_TRUE_PEAK_ERROR, "%d Hz: true peak off by %.3f dB at %d Hz", sample_rate, worst_error, (i32)worst_frequency);
+
+			// fs / 4 at 45 degrees, every sample sits 3 dB below the crest
+			fill_sines(samples, sample_rate, sample_rate / 4.0, TRUE_PEAK_AMPLITUDE, TEST_SECONDS, 0, PI / 4);
+			meter(samples, sample_rate);
+			f32 peak = s_meter.true_peak_max.load();
+			check(fabs(peak - expected_peak) <= MAX_TRUE_PEAK_ERROR, "%d Hz: fs / 4 between the samples reads %.2f dBTP", sample_rate, peak);
+		}
+	}
+
+	// a device at 48 kHz on the capture thread
+	init_loudness(48000);
+	for(u32 n = 0; n < TEST_SECONDS * 48000; n++) samples[n] = (i16)(((n * 2654435761u) >> 16) % 20000 - 10000);
+	for(u32 level = 0; level <= supported; level++) {
+		use_simd_level(level);
+		f64 time = time_microseconds(5, 1, [&]() { meter(samples, 48000); });
+		printf("%-8s %.3f%% of a core per 48 kHz device (target %.0f%%)\n", s_simd_level_names[level],
+			time / (TEST_SECONDS * 1000000.0) * 100, COST_TARGET);
+	}
+
+	r_free(samples);
+	return finish_test("loudness");
+}
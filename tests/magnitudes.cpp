@@ -0,0 +1,83 @@
+#include <stdlib.h>
+#include "test.h"
+#include "../src/simd.cpp"
+
+//NOTE: the magnitude and decibel kernels of every simd level the cpu supports against the inline double precision path render()
+// used to run per column, at the bin counts of the default and the largest fft. Every variant has to match a double precision
+// reference first, the timings are only printed.
+global const u32 BIN_COUNTS[]     = { 11025, 65536 };
+global const u32 BIN_COUNT_COUNT  = sizeof(BIN_COUNTS) / sizeof(BIN_COUNTS[0]);
+global const u32 ROUNDS           = 20;
+global const f32 DECIBEL_OFFSET   = -90.3f; // anything, the kernels only add it
+
+typedef void (*MagnitudeKernel)(const f32* bins, f32* magnitudes, u32 count);
+typedef void (*DecibelKernel)(const f32* magnitudes, f32* decibels, u32 count, f32 offset);
+
+global const MagnitudeKernel s_magnitude_kernels[SIMD_LEVEL_COUNT] = { compute_magnitudes_scalar, compute_magnitudes_sse2, compute_magnitudes_avx2 };
+global const DecibelKernel   s_decibel_kernels[SIMD_LEVEL_COUNT]   = { magnitudes_to_decibels_scalar, magnitudes_to_decibels_sse2, magnitudes_to_decibels_avx2 };
+
+global volatile f64 s_sink; // keeps the inline path from being optimized away
+
+i32 main()
+{
+	SimdLevel supported = detect_simd_level();
+	srand(1);
+
+	for(u32 b = 0; b < BIN_COUNT_COUNT; b++) {
+		u32 count = BIN_COUNTS[b];
+		// interleaved complex bins like fftw's output, spread over the range a 16 bit capture produces
+		f32* bins       = (f32*)r_allocate(2 * count * sizeof(f32));
+		f32* magnitudes = (f32*)r_allocate(count * sizeof(f32));
+		f32* decibels   = (f32*)r_allocate(count * sizeof(f32));
+		f64* reference  = (f64*)r_allocate(count * sizeof(f64));
+		for(u32 i = 0; i < 2 * count; i++) {
+			bins[i] = (f32)((rand() - RAND_MAX / 2) * pow(10.0, rand() % 8) / RAND_MAX);
+		}
+		for(u32 i = 0; i < count; i++) {
+			reference[i] = sqrt((f64)bins[2 * i] * bins[2 * i] + (f64)bins[2 * i + 1] * bins[2 * i + 1]);
+		}
+
+		f64 inline_magnitudes = time_microseconds(ROUNDS, 50, [&]() {
+			f64 sum = 0;
+			for(u32 i = 0; i < count; i++) sum += sqrt((f64)bins[2 * i] * bins[2 * i] + (f64)bins[2 * i + 1] * bins[2 * i + 1]);
+			s_sink = sum;
+		});
+		f64 inline_decibels = time_microseconds(ROUNDS, 50, [&]() {
+			f64 sum = 0;
+			for(u32 i = 0; i < count; i++) sum += 20 * log10(max(reference[i], (f64)FAST_LOG_MIN)) + DECIBEL_OFFSET;
+			s_sink = sum;
+		});
+		printf("%d bins\n", count);
+		printf("    %-8s magnitudes %8.1f us, decibels %8.1f us\n", "inline", inline_magnitudes, inline_decibels);
+
+		for(u32 level = 0; level <= supported; level++) {
+			MagnitudeKernel magnitude_kernel = s_magnitude_kernels[level];
+			DecibelKernel   decibel_kernel   = s_decibel_kernels[level];
+
+			magnitude_kernel(bins, magnitudes, count);
+			u32 wrong_magnitudes = 0;
+			for(u32 i = 0; i < count; i++) {
+				if(fabs(magnitudes[i] - reference[i]) > 1e-6 * reference[i] + 1e-30) wrong_magnitudes++;
+			}
+			check(!wrong_magnitudes, "%s: %d of %d magnitudes off", s_simd_level_names[level], wrong_magnitudes, count);
+
+			decibel_kernel(magnitudes, decibels, count, DECIBEL_OFFSET);
+			u32 wrong_decibels = 0;
+			for(u32 i = 0; i < count; i++) {
+				f64 expected = 20 * log10(max((f64)magnitudes[i], (f64)FAST_LOG_MIN)) + DECIBEL_OFFSET;
+				if(fabs(decibels[i] - expected) > 1e-3) wrong_decibels++;
+			}
+			check(!wrong_decibels, "%s: %d of %d decibels off", s_simd_level_names[level], wrong_decibels, count);
+
+			f64 magnitude_time = time_microseconds(ROUNDS, 50, [&]() { magnitude_kernel(bins, magnitudes, count); });
+			f64 decibel_time   = time_microseconds(ROUNDS, 50, [&]() { decibel_kernel(magnitudes, decibels, count, DECIBEL_OFFSET); });
+			printf("    %-8s magnitudes %8.1f us, decibels %8.1f us\n", s_simd_level_names[level], magnitude_time, decibel_time);
+		}
+
+		r_free(bins);
+		r_free(magnitudes);
+		r_free(decibels);
+		r_free(reference);
+	}
+	return finish_test("magnitude and decibel kernels");
+}
@@ -0,0 +1,110 @@
+#include "test.h"
+#include "../src/pitch.cpp"
+
+//NOTE: both pitch trackers on synthetic tones with harmonics and a bit of noise, at the default fft size and the capture rate,
+// then what keeping up with MAX_DEVICES devices at the default hop costs. Every frequency also runs with a second harmonic twice
+// as strong as the fundamental, the case that reads an octave high without the octave check.
+global const u32 SAMPLE_RATE      = 44100;
+global const u32 FFT_SIZE_INDEX   = 4; // s_fft_size_index's default
+global const u32 MAX_DEVICES      = 8;
+global const u32 SIGNAL_SAMPLES   = 65536;
+global const f64 MAX_ERROR_CENTS  = 5;
+global const f32 MIN_CONFIDENCE   = 0.8f;
+global const f32 NOISE_CONFIDENCE = 0.5f; // yin on noise has to say it isn't sure
+global const f32 TEST_FREQUENCIES[] = { 41.2f, 55.0f, 110.0f, 220.5f, 440.0f, 987.77f, 1500.0f, 1975.5f };
+global const u32 TEST_FREQUENCY_COUNT = sizeof(TEST_FREQUENCIES) / sizeof(TEST_FREQUENCIES[0]);
+
+global u32  s_noise_state = 1;
+global f32* s_magnitudes;
+
+// uniform in [-1, 1), deterministic so failures reproduce
+f32 noise()
+{
+	s_noise_state = s_noise_state * 1664525 + 1013904223;
+	return (f32)(i32)s_noise_state / 2147483648.0f;
+}
+
+void write_harmonic_tone(SampleRing* ring, f32 frequency, bool strong_second)
+{
+	i16* samples = (i16*)r_allocate(SIGNAL_SAMPLES * sizeof(i16));
+	for(u32 n = 0; n < SIGNAL_SAMPLES; n++) {
+		f64 value = 0;
+		for(u32 h = 1; h <= 6 && frequency * h < SAMPLE_RATE / 2; h++) {
+			f64 amplitude = h == 1 ? 3000 : h == 2 && strong_second ? 6000 : 2000.0 / h;
+			value += amplitude * sin(2 * PI * frequency * h * n / SAMPLE_RATE + h);
+		}
+		samples[n] = (i16)lrint(value + 20 * noise());
+	}
+	// nobody else reads the ring, the previous tone can go
+	ring_release(ring, ring_available(ring));
+	ring_write(ring, samples, SIGNAL_SAMPLES);
+	r_free(samples);
+}
+
+PitchEstimate pitch_of_hps(PitchState* state, SampleRing* ring, u64 frame_end)
+{
+	FFTPlan& plan = s_fft_plans[FFT_SIZE_INDEX];
+	RingSpan span = ring_span(ring, frame_end - plan.size, plan.size);
+	f32* in = fft_input(0, plan.size);
+	convert_i16_to_f32_windowed(span.first, plan.window, in, span.first_length);
+	convert_i16_to_f32_windowed(span.second, plan.window + span.first_length, in + span.first_length, span.second_length);
+	fftwf_execute_dft_r2c(plan.plan, in, fft_output(0, plan.size));
+	compute_magnitudes((f32*)fft_output(0, plan.size), s_magnitudes, plan.size / 2 + 1);
+	return estimate_pitch_hps(state, s_magnitudes, plan.size / 2 + 1, (f32)SAMPLE_RATE / plan.size);
+}
+
+f64 error_cents(f32 estimate, f32 frequency)
+{
+	return fabs(1200 * log2(estimate / frequency));
+}
+
+i32 main()
+{
+	init_simd();
+	create_fft_plans(1);
+	PitchState state = {};
+	create_pitch_plans(&state, 1);
+	SampleRing ring = {};
+	ring_init(&ring, SAMPLE_RATE * 5);
+	s_magnitudes = (f32*)r_allocate((MAX_FFT_SIZE / 2 + 1) * sizeof(f32));
+
+	for(u32 i = 0; i < TEST_FREQUENCY_COUNT; i++) {
+		for(u32 strong_second = 0; strong_second < 2; strong_second++) {
+			f32 frequency = TEST_FREQUENCIES[i];
+			write_harmonic_tone(&ring, frequency, strong_second);
+			u64 frame_end = ring_available(&ring);
+			PitchEstimate hps = pitch_of_hps(&state, &ring, frame_end);
+			PitchEstimate yin = estimate_pitch_yin(&state, &ring, frame_end, SAMPLE_RATE);
+			printf("%8.2f Hz%s: hps %8.2f Hz (%.2f), yin %8.2f Hz (%.2f)\n", frequency, strong_second ? ", strong 2nd" : "             ",
+				hps.frequency, hps.confidence, yin.frequency, yin.confidence);
+			check(error_cents(hps.frequency, frequency) <= MAX_ERROR_CENTS, "hps reads %.2f Hz for %.2f Hz", hps.frequency, frequency);
+			check(error_cents(yin.frequency, frequency) <= MAX_ERROR_CENTS, "yin reads %.2f Hz for %.2f Hz", yin.frequency, frequency);
+			check(hps.confidence >= MIN_CONFIDENCE, "hps confidence %.2f at %.2f Hz", hps.confidence, frequency);
+			check(yin.confidence >= MIN_CONFIDENCE, "yin confidence %.2f at %.2f Hz", yin.confidence, frequency);
+		}
+	}
+
+	{
+		i16* samples = (i16*)r_allocate(SIGNAL_SAMPLES * sizeof(i16));
+		for(u32 n = 0; n < SIGNAL_SAMPLES; n++) samples[n] = (i16)(3000 * noise());
+		ring_release(&ring, ring_available(&ring));
+		ring_write(&ring, samples, SIGNAL_SAMPLES);
+		r_free(samples);
+		PitchEstimate yin = estimate_pitch_yin(&state, &ring, ring_available(&ring), SAMPLE_RATE);
+		printf("   noise: yin %.2f Hz (%.2f)\n", yin.frequency, yin.confidence);
+		check(yin.confidence < NOISE_CONFIDENCE, "yin is %.2f sure about noise", yin.confidence);
+	}
+
+	// every device gets an estimate per hop
+	FFTPlan& plan = s_fft_plans[FFT_SIZE_INDEX];
+	u64 frame_end = ring_available(&ring);
+	f64 hps_time = time_microseconds(10, 20, [&]() {
+		compute_magnitudes((f32*)fft_output(0, plan.size), s_magnitudes, plan.size / 2 + 1);
+		estimate_pitch_hps(&state, s_magnitudes, plan.size / 2 + 1, (f32)SAMPLE_RATE / plan.size);
+	});
+	f64 yin_time = time_microseconds(10, 20, [&]() { estimate_pitch_yin(&state, &ring, frame_end, SAMPLE_RATE); });
+	f64 hops_per_second = (f64)SAMPLE_RATE / s_stft_hop.current * MAX_DEVICES;
+	printf("%d devices at a hop of %d: hps %.1f us per frame, %.2f%% of a core, yin %.1f us per frame, %.2f%% of a core\n",
+		MAX_DEVICES, (i32)s_stft_hop.current, hps_time, hps_time * hops_per_second / 10000, yin_time, yin_time * hops_per_second / 10000);
+	return finish_test("pitch");
+}
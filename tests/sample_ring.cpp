@@ -0,0 +1,87 @@
+#include "test.h"
+#include "../src/sample_ring.cpp"
+
+//NOTE: a producer thread writes a synthetic capture at RATE_FACTOR times real time in chunks of a few milliseconds, the
+// consumer reads and releases like the analysis does, with a stall every now and then like a slow frame. Every sample carries a
+// hash of its position, so a lost, repeated, reordered or torn sample shows up as a mismatch at the position the consumer
+// expects next.
+global const u32 SAMPLE_RATE    = 44100;
+global const u32 RATE_FACTOR    = 10;
+global const u32 RING_SECONDS   = 5; // like s_buffered_seconds
+global const f64 TEST_SECONDS   = 5;
+global const u32 CHUNK_SAMPLES  = SAMPLE_RATE * RATE_FACTOR / 1000; // a millisecond at the test rate
+global const u32 STALL_EVERY    = 200; // consumer iterations
+global const u32 STALL_MS       = 50;
+
+struct StressState {
+	SampleRing        ring;
+	std::atomic<bool> producing;
+	u64               produced;
+};
+
+i16 sample_at(u64 position)
+{
+	return (i16)((u32)(position * 2654435761u) >> 16);
+}
+
+void producer(void* data)
+{
+	StressState* state = (StressState*)data;
+	i16 chunk[CHUNK_SAMPLES];
+	f64 start = get_seconds();
+	u64 position = 0;
+	while(get_seconds() - start < TEST_SECONDS) {
+		// catch up with the wall clock, like a capture buffer that filled while the thread slept
+		u64 due = (u64)((get_seconds() - start) * SAMPLE_RATE * RATE_FACTOR);
+		while(position < due) {
+			u32 count = (u32)min(due - position, (u64)CHUNK_SAMPLES);
+			for(u32 i = 0; i < count; i++) chunk[i] = sample_at(position + i);
+			u32 written = ring_write(&state->ring, chunk, count);
+			position += written;
+			if(written < count) break; // dropped, counted by the ring
+		}
+		sleep_milliseconds(1);
+	}
+	state->produced = position;
+	state->producing.store(false, std::memory_order_release);
+}
+
+i32 main()
+{
+	StressState* state = (StressState*)r_allocate(sizeof(StressState));
+	ring_init(&state->ring, SAMPLE_RATE * RING_SECONDS);
+	state->producing.store(true);
+	void* thread = start_thread(producer, state);
+
+	u64 consumed   = 0;
+	u64 mismatches = 0;
+	u64 first_mismatch = 0;
+	for(u32 iteration = 0;; iteration++) {
+		bool producing = state->producing.load(std::memory_order_acquire);
+		u64 available = ring_available(&state->ring);
+		while(consumed < available) {
+			u32 count = (u32)min(available - consumed, (u64)state->ring.capacity / 4);
+			RingSpan span = ring_span(&state->ring, consumed, count);
+			for(u32 i = 0; i < span.first_length; i++) {
+				if(span.first[i] != sample_at(consumed + i) && !mismatches++) first_mismatch = consumed + i;
+			}
+			for(u32 i = 0; i < span.second_length; i++) {
+				u64 position = consumed + span.first_length + i;
+				if(span.second[i] != sample_at(position) && !mismatches++) first_mismatch = position;
+			}
+			consumed += count;
+			ring_release(&state->ring, consumed);
+		}
+		if(!producing) break;
+		sleep_milliseconds(iteration % STALL_EVERY == STALL_EVERY - 1 ? STALL_MS : 2);
+	}
+	join_thread(thread);
+
+	u64 expected = (u64)(TEST_SECONDS * SAMPLE_RATE * RATE_FACTOR);
+	printf("%d x real time: %d samples in %d s, ring of %d samples\n", RATE_FACTOR, (i32)consumed, (i32)TEST_SECONDS, state->ring.capacity);
+	check(state->ring.dropped_count.load() == 0, "%d samples dropped", (i32)state->ring.dropped_count.load());
+	check(mismatches == 0, "%d samples out of place, the first at %d", (i32)mismatches, (i32)first_mismatch);
+	check(consumed == state->produced, "consumed %d of %d produced samples", (i32)consumed, (i32)state->produced);
+	check(consumed >= expected * 9 / 10, "only %d of about %d samples went through", (i32)consumed, (i32)expected);
+	return finish_test("sample ring stress");
+}
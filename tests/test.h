@@ -0,0 +1,43 @@
+#pragma once
+#include <stdio.h>
+#include "../src/basetypes.h"
+#include "../src/platform_win32_system.cpp"
+#include "../src/format.cpp"
+
+///////////////////////////////////////////////////////////
+//                         Tests                         //
+///////////////////////////////////////////////////////////
+
+//NOTE: every test is a unity build of the modules it covers like main.cpp, linked against the window independent part of the
+// platform layer. Failed checks get printed and counted, the process exits with the count so build_tests.bat stops on it.
+// Benchmarks print their numbers and only fail when a result is wrong, timings depend too much on the machine to assert.
+
+global u32 s_failed_checks;
+
+#define check(condition, ...) do { \
+	if(!(condition)) { \
+		s_failed_checks++; \
+		printf("%s:%d: check failed: %s\n    ", __FILE__, __LINE__, #condition); \
+		printf(__VA_ARGS__); \
+		printf("\n"); \
+	} \
+} while(0)
+
+i32 finish_test(const char* name)
+{
+	printf("%s: %s (%d failed checks)\n", name, s_failed_checks ? "FAILED" : "passed", s_failed_checks);
+	return (i32)s_failed_checks;
+}
+
+// microseconds per call of `function`, the best of `rounds` rounds of `calls` calls
+template<typename Function>
+f64 time_microseconds(u32 rounds, u32 calls, Function function)
+{
+	f64 best = 1e30;
+	for(u32 r = 0; r < rounds; r++) {
+		f64 start = get_seconds();
+		for(u32 c = 0; c < calls; c++) function();
+		best = min(best, (get_seconds() - start) * 1000000 / calls);
+	}
+	return best;
+}
@@ -0,0 +1,88 @@
+#include "test.h"
+#include "../src/tones.cpp"
+
+//NOTE: the tone bank on a stream of known sines, fed in capture sized chunks like the capture thread does. Every tracked tone
+// has to read amplitude / 2 within MAX_LEVEL_ERROR_DB once a block covers MIN_PERIODS of it, below that the hann window's main
+// lobe reaches its image at the negative frequency. A tracked frequency with nothing on it has to stay MIN_REJECTION_DB below
+// the strongest tone. Then the cost of MAX_DEVICES devices with a full bank at the capture rate.
+global const u32 SAMPLE_RATE       = 44100;
+global const u32 MAX_DEVICES       = 8;
+global const u32 CAPTURE_CHUNK     = 441; // 10 ms
+global const u32 SIGNAL_SAMPLES    = SAMPLE_RATE * 2;
+global const f64 MAX_LEVEL_ERROR_DB = 0.1;
+global const f64 MIN_REJECTION_DB  = 60;
+global const f32 MIN_PERIODS       = 4;
+
+struct TestTone {
+	f32 frequency;
+	f32 amplitude;
+};
+
+// 50 Hz hum, a pilot tone off the bin grid and one near the top, plus a tracked frequency that isn't there
+global const TestTone TEST_TONES[] = { { 50.0f, 2000.0f }, { 1000.5f, 10000.0f }, { 19000.0f, 300.0f }, { 7000.0f, 0.0f } };
+global const u32      TEST_TONE_COUNT = sizeof(TEST_TONES) / sizeof(TEST_TONES[0]);
+
+global ToneBank s_banks[MAX_DEVICES];
+
+void feed(ToneBank* bank, const i16* samples, u32 count)
+{
+	u32 generation;
+	ToneConfig* config = acquire_tone_config(&generation);
+	for(u32 done = 0; done < count; done += CAPTURE_CHUNK) {
+		process_tones(bank, config, generation, samples + done, min(CAPTURE_CHUNK, count - done));
+	}
+	release_tone_config(generation);
+}
+
+i32 main()
+{
+	init_simd();
+	allocate_tone_configs();
+
+	i16* samples = (i16*)r_allocate(SIGNAL_SAMPLES * sizeof(i16));
+	for(u32 n = 0; n < SIGNAL_SAMPLES; n++) {
+		f64 value = 0;
+		for(u32 t = 0; t < TEST_TONE_COUNT; t++) value += TEST_TONES[t].amplitude * sin(2 * PI * TEST_TONES[t].frequency * n / SAMPLE_RATE);
+		samples[n] = (i16)lrint(value);
+	}
+
+	for(u32 block = (u32)s_tone_block.min; block <= (u32)s_tone_block.max; block *= 4) {
+		s_tone_block.current = (f32)block;
+		clear_tones();
+		for(u32 t = 0; t < TEST_TONE_COUNT; t++) add_tone(TEST_TONES[t].frequency);
+		check(publish_tone_config(SAMPLE_RATE), "the configuration didn't get published");
+		feed(&s_banks[0], samples, SIGNAL_SAMPLES);
+
+		printf("block of %5d:", block);
+		for(u32 t = 0; t < TEST_TONE_COUNT; t++) {
+			f32 level    = s_banks[0].levels[t].load();
+			f32 expected = TEST_TONES[t].amplitude / 2;
+			printf(" %.1f Hz %.1f", TEST_TONES[t].frequency, level);
+			if(TEST_TONES[t].frequency * block / SAMPLE_RATE < MIN_PERIODS) continue;
+			if(expected) {
+				f64 error = fabs(20 * log10(level / expected));
+				check(error <= MAX_LEVEL_ERROR_DB, "block %d: %.1f Hz reads %.1f instead of %.1f", block, TEST_TONES[t].frequency, level, expected);
+			}
+			else {
+				f64 rejection = 20 * log10(TEST_TONES[1].amplitude / 2 / max(level, 1e-9f));
+				check(rejection >= MIN_REJECTION_DB, "block %d: %.1f Hz picks up %.1f", block, TEST_TONES[t].frequency, level);
+			}
+		}
+		printf("\n");
+	}
+
+	// a full bank on every device
+	clear_tones();
+	for(u32 t = 0; t < MAX_TONES; t++) add_tone(50.0f + 300.0f * t);
+	s_tone_block.current = 2048;
+	publish_tone_config(SAMPLE_RATE);
+	f64 time = time_microseconds(5, 1, [&]() {
+		for(u32 d = 0; d < MAX_DEVICES; d++) feed(&s_banks[d], samples, SIGNAL_SAMPLES);
+	});
+	f64 signal_microseconds = SIGNAL_SAMPLES * 1000000.0 / SAMPLE_RATE;
+	printf("%s: %d devices x %d tones, %.2f%% of a core\n", s_simd_level_names[s_simd_level], MAX_DEVICES, MAX_TONES,
+		time / signal_microseconds * 100);
+
+	r_free(samples);
+	return finish_test("tone bank");
+}